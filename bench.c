@@ -0,0 +1,406 @@
+#define _GNU_SOURCE /* memfd_create */
+#include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "lib_tar.h"
+
+/**
+ * Micro-benchmarks of the library.
+ *
+ * Usage: ./bench [tar_file]
+ * Without argument, synthetic archives are generated in /tmp.
+ */
+
+#define BENCH_FILES 20000
+#define BENCH_FILE_SIZE 700
+#define BENCH_WORKERS 16
+#define BENCH_NAMES 200000        /* entries of the archives of bench_names(), 124-byte paths */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fills a ustar header, checksum included. The path is prefix/name, prefix can be "". */
+static void make_header(tar_header_t *header, const char *prefix, const char *name, char typeflag, size_t size) {
+    memset(header, 0, sizeof(tar_header_t));
+    memcpy(header->prefix, prefix, strnlen(prefix, sizeof(header->prefix)));
+    memcpy(header->name, name, strnlen(name, sizeof(header->name)));
+    snprintf(header->mode, sizeof(header->mode), "%07o", 0644);
+    snprintf(header->uid, sizeof(header->uid), "%07o", 1000);
+    snprintf(header->gid, sizeof(header->gid), "%07o", 1000);
+    snprintf(header->size, sizeof(header->size), "%011o", (unsigned) size);
+    snprintf(header->mtime, sizeof(header->mtime), "%011o", 1700000000u);
+    header->typeflag = typeflag;
+    memcpy(header->magic, TMAGIC, TMAGLEN);
+    memcpy(header->version, TVERSION, TVERSLEN);
+    memset(header->chksum, ' ', sizeof(header->chksum));
+    unsigned checksum = 0;
+    for (size_t i = 0; i < sizeof(tar_header_t); i++) {
+        checksum += ((unsigned char *) header)[i];
+    }
+    snprintf(header->chksum, sizeof(header->chksum), "%06o", checksum);
+}
+
+/* Writes an archive of BENCH_FILES regular files, 1000 per directory, to path. */
+static int make_archive(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    uint8_t block[512];
+    size_t padded = (BENCH_FILE_SIZE + 511) / 512 * 512;
+    uint8_t *payload = calloc(1, padded);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        char name[100];
+        if (i % 1000 == 0) {
+            snprintf(name, sizeof(name), "dir%d/", i / 1000);
+            make_header((tar_header_t *) block, "", name, DIRTYPE, 0);
+            if (write(fd, block, sizeof(block)) != sizeof(block)) {
+                free(payload);
+                close(fd);
+                return -1;
+            }
+        }
+        snprintf(name, sizeof(name), "dir%d/file%d", i / 1000, i);
+        make_header((tar_header_t *) block, "", name, REGTYPE, BENCH_FILE_SIZE);
+        if (write(fd, block, sizeof(block)) != sizeof(block) || write(fd, payload, padded) != padded) {
+            free(payload);
+            close(fd);
+            return -1;
+        }
+    }
+    memset(block, 0, sizeof(block));
+    write(fd, block, sizeof(block));
+    write(fd, block, sizeof(block));
+    free(payload);
+    fsync(fd);//des pages sales ne pourraient pas être retirées du cache par bench_io
+    close(fd);
+    return 0;
+}
+
+static void bench_parse(void) {
+    tar_header_t header;
+    make_header(&header, "", "bench", REGTYPE, 123456789);
+    const int rounds = 10000000;
+    volatile int64_t sink = 0;
+
+    double start = now();
+    for (int i = 0; i < rounds; i++) {
+        char field[13];
+        memcpy(field, header.size, 12);
+        field[12] = '\0';//strtol a besoin d'une chaîne terminée
+        sink += strtol(field, NULL, 8);
+    }
+    double t_strtol = now() - start;
+
+    start = now();
+    for (int i = 0; i < rounds; i++) {
+        sink += TAR_INT(header.size);
+    }
+    double t_parse = now() - start;
+
+    printf("parse size field:  strtol %.2f ns  tar_parse_int %.2f ns\n",
+           t_strtol * 1e9 / rounds, t_parse * 1e9 / rounds);
+    (void) sink;
+}
+
+static void bench_scan(int fd) {
+    const int rounds = 5;
+    int nb_headers = 0;
+    double start = now();
+    for (int i = 0; i < rounds; i++) {
+        nb_headers = check_archive(fd);
+    }
+    double elapsed = (now() - start) / rounds;
+    if (nb_headers <= 0) {
+        printf("check_archive returned %d\n", nb_headers);
+        return;
+    }
+    printf("check_archive:     %d headers  %.3f ms  %.1f ns/header\n",
+           nb_headers, elapsed * 1e3, elapsed * 1e9 / nb_headers);
+}
+
+static void bench_index(int fd) {
+    tar_index_t *index;
+    double start = now();
+    int count = tar_index_open(fd, 0, &index);
+    double t_open = now() - start;
+    if (count <= 0) {
+        printf("tar_index_open returned %d\n", count);
+        return;
+    }
+    printf("tar_index_open:    %d entries  %.3f ms  %.1f ns/header\n", count, t_open * 1e3, t_open * 1e9 / count);
+    size_t footprint = tar_index_size(index);
+    printf("tar_index_size:    %zu bytes  %.1f bytes/entry\n", footprint, (double) footprint / count);
+
+    struct tar_stat *entries = malloc(count * sizeof(struct tar_stat));
+    size_t no_entries = count;
+    start = now();
+    int ret = tar_readdir_plus(index, "dir0/", entries, &no_entries);
+    double t_readdir = now() - start;
+    printf("tar_readdir_plus:  %zu entries  %.3f ms\n", ret ? no_entries : 0, t_readdir * 1e3);
+
+    tar_cursor_t cursor;
+    static char paths[64][TAR_PATH_MAX + 1];
+    char *batch[64];
+    for (size_t i = 0; i < 64; i++) {
+        batch[i] = paths[i];
+    }
+    size_t listed = 0;
+    start = now();
+    ssize_t total = tar_list_begin(index, "dir0/", &cursor);
+    for (size_t n; total >= 0 && (n = tar_list_next(&cursor, batch, 64)) > 0;) {
+        listed += n;
+    }
+    double t_list = now() - start;
+    printf("tar_list_next:     %zu/%zd entries  %.3f ms\n", listed, total, t_list * 1e3);
+
+    const int rounds = 1000000;
+    volatile uint64_t sink = 0;
+    struct tar_stat st;
+    start = now();
+    for (int i = 0; i < rounds; i++) {
+        if (tar_stat(index, "dir1/file1999", &st) == 0) {
+            sink += st.size;
+        }
+    }
+    double t_stat = now() - start;
+    printf("tar_stat:          %.1f ns\n", t_stat * 1e9 / rounds);
+    (void) sink;
+    free(entries);
+    tar_index_close(index);
+}
+
+static void bench_hash(int fd) {
+    static const struct {
+        const char *name;
+        int flags;
+    } modes[] = {
+        { "none", 0 },
+        { "crc32c", TAR_HASH_CRC32C },
+        { "xxh64", TAR_HASH_XXH64 },
+        { "sha256", TAR_HASH_SHA256 },
+    };
+    off_t archive_size = lseek(fd, 0, SEEK_END);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        tar_index_t *index;
+        double start = now();
+        int count = tar_index_open(fd, modes[i].flags, &index);
+        double elapsed = now() - start;
+        if (count < 0) {
+            printf("tar_index_open returned %d\n", count);
+            return;
+        }
+        printf("index + %-7s    %.3f ms  %.0f MB/s\n", modes[i].name, elapsed * 1e3, archive_size / elapsed / 1e6);
+        tar_index_close(index);
+    }
+}
+
+/* Fraction of the pages of the archive that are in the page cache. */
+static double cached_fraction(int fd) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    long page = sysconf(_SC_PAGESIZE);
+    size_t nb_pages = (size + page - 1) / page;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    unsigned char *vec = malloc(nb_pages);
+    if (map == MAP_FAILED || vec == NULL || mincore(map, size, vec) == -1) {
+        free(vec);
+        return -1;
+    }
+    size_t resident = 0;
+    for (size_t i = 0; i < nb_pages; i++) {
+        resident += vec[i] & 1;
+    }
+    munmap(map, size);
+    free(vec);
+    return (double) resident / nb_pages;
+}
+
+static void bench_io(int fd) {
+    static const struct {
+        const char *name;
+        int flags;
+    } modes[] = {
+        { "buffered", 0 },
+        { "dontneed", TAR_IO_DONTNEED },
+        { "direct", TAR_IO_DIRECT },
+    };
+    off_t archive_size = lseek(fd, 0, SEEK_END);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);//on part d'un cache vide
+        tar_index_t *index;
+        double start = now();
+        int count = tar_index_open(fd, TAR_HASH_CRC32C | modes[i].flags, &index);
+        double elapsed = now() - start;
+        if (count < 0) {
+            printf("tar_index_open returned %d\n", count);
+            return;
+        }
+        printf("io %-9s       %.3f ms  %.0f MB/s  %.0f%% of the archive left in the page cache\n", modes[i].name,
+               elapsed * 1e3, archive_size / elapsed / 1e6, cached_fraction(fd) * 100);
+        tar_index_close(index);
+    }
+}
+
+/*
+ * Path of entry i of the archives of bench_names(), 124 bytes in both shapes. With shared_prefixes, the long part is
+ * in 2000 directories of 100 files each; otherwise the directories are short and the long part is a unique basename.
+ */
+static void names_path(int i, bool shared_prefixes, char *prefix, char *name) {
+    if (shared_prefixes) {
+        snprintf(prefix, 155, "project_%02d/some_rather_long_module_directory_%03d/src/main/resources/generated",
+                 i / 10000, i / 100 % 100);
+        snprintf(name, 100, "component_with_long_file_name_%05d.properties", i % 100);
+    } else {
+        snprintf(prefix, 155, "project_%02d/module_%03d/src/main/resources", i / 10000, i / 100 % 100);
+        snprintf(name, 100, "%06d_generated_component_with_a_rather_long_file_name_unique_per_entry.properties", i);
+    }
+}
+
+/*
+ * Footprint of the index for two archives of BENCH_NAMES empty files with the same path length: the interned path
+ * components only save memory on the prefixes shared by many entries, unique basenames are stored in full.
+ */
+static void bench_names(const char *path) {
+    for (int shared_prefixes = 1; shared_prefixes >= 0; shared_prefixes--) {
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            perror("open(names archive)");
+            return;
+        }
+        static tar_header_t headers[1024];//écrits par paquets
+        size_t raw = 0;
+        int ok = 1;
+        for (int i = 0; i < BENCH_NAMES && ok; i += 1024) {
+            int n = BENCH_NAMES - i < 1024 ? BENCH_NAMES - i : 1024;
+            for (int j = 0; j < n; j++) {
+                char prefix[155];
+                char name[100];
+                names_path(i + j, shared_prefixes, prefix, name);
+                make_header(&headers[j], prefix, name, REGTYPE, 0);
+                raw += strlen(prefix) + 1 + strlen(name);
+            }
+            ok = write(fd, headers, n * sizeof(tar_header_t)) == (ssize_t) (n * sizeof(tar_header_t));
+        }
+        static const uint8_t end[2 * 512];//les deux blocs vides de fin d'archive
+        ok = ok && write(fd, end, sizeof(end)) == sizeof(end);
+        tar_index_t *index;
+        int count = ok ? tar_index_open(fd, 0, &index) : -4;
+        if (count <= 0) {
+            printf("tar_index_open returned %d\n", count);
+        } else {
+            printf("names %-16s %d entries  %.1f path bytes/entry  index %.1f bytes/entry\n",
+                   shared_prefixes ? "shared prefixes:" : "unique names:", count, (double) raw / count,
+                   (double) tar_index_size(index) / count);
+            tar_index_close(index);
+        }
+        close(fd);
+        unlink(path);
+    }
+}
+
+/* Private memory of the process (pages not shared with other processes), in kB. */
+static long private_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    long total = 0;
+    long kb;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Private_Clean: %ld kB", &kb) == 1 || sscanf(line, "Private_Dirty: %ld kB", &kb) == 1) {
+            total += kb;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+static void bench_shared(int fd) {
+    tar_index_t *index;
+    int count = tar_index_open(fd, 0, &index);
+    if (count <= 0) {
+        printf("tar_index_open returned %d\n", count);
+        return;
+    }
+    int shm_fd = memfd_create("bench.idx", MFD_ALLOW_SEALING);
+    double start = now();
+    int ret = shm_fd == -1 ? -4 : tar_index_export(index, shm_fd);
+    double t_export = now() - start;
+    tar_index_close(index);
+    if (ret != 0) {
+        printf("tar_index_export returned %d\n", ret);
+        return;
+    }
+
+    const int rounds = 1000;
+    start = now();
+    for (int i = 0; i < rounds; i++) {
+        tar_index_attach(fd, shm_fd, &index);
+        tar_index_close(index);
+    }
+    double t_attach = (now() - start) / rounds;
+    printf("tar_index_export:  %.3f ms  tar_index_attach %.1f us\n", t_export * 1e3, t_attach * 1e6);
+
+    /* chaque worker attache l'index, le parcourt en entier, et mesure la mémoire qu'il n'a pas en commun */
+    fflush(stdout);//sinon les workers héritent du tampon et le réécrivent
+    start = now();
+    for (int w = 0; w < BENCH_WORKERS; w++) {
+        if (fork() != 0) {
+            continue;
+        }
+        long before = private_kb();
+        if (tar_index_attach(fd, shm_fd, &index) < 0) {
+            _exit(1);
+        }
+        struct tar_stat st;
+        char path[TAR_PATH_MAX + 1];
+        for (int i = 0; i < BENCH_FILES; i++) {
+            snprintf(path, sizeof(path), "dir%d/file%d", i / 1000, i);
+            tar_stat(index, path, &st);
+        }
+        long after = private_kb();
+        if (w == 0) {
+            printf("worker:            %zu bytes shared  %ld kB private after %d tar_stat\n",
+                   tar_index_size(index), after - before, BENCH_FILES);
+            fflush(stdout);//_exit() ne vide pas le tampon
+        }
+        tar_index_close(index);
+        _exit(0);
+    }
+    while (wait(NULL) > 0) {
+    }
+    printf("%d workers:        %.3f ms\n", BENCH_WORKERS, (now() - start) * 1e3);
+    close(shm_fd);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc >= 2 ? argv[1] : "/tmp/bench_lib_tar.tar";
+    if (argc < 2 && make_archive(path) == -1) {
+        perror("make_archive");
+        return -1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open(tar_file)");
+        return -1;
+    }
+
+    bench_parse();
+    bench_scan(fd);
+    bench_index(fd);
+    bench_shared(fd);
+    if (argc < 2) {
+        bench_names("/tmp/bench_lib_tar_names.tar");
+    }
+    bench_hash(fd);
+    bench_io(fd);
+
+    close(fd);
+    return 0;
+}
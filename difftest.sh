@@ -0,0 +1,183 @@
+#!/bin/sh
+# Differential test: compares what the library says about archives built by GNU tar with what GNU tar says.
+#
+# Usage: ./difftest.sh [corpus_dir]
+# The generated archives are copied to corpus_dir if given (seeds for ./fuzz).
+
+TESTS=${TESTS:-./tests}
+TAR=${TAR:-tar}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=$work/failures
+: > "$failures"
+
+# la boucle de check_archive tourne dans un sous-shell, les échecs sont comptés dans un fichier
+fail() {
+    echo "FAIL $archive${TESTS_SHARED_INDEX:+ (shared)}${TESTS_IO:+ ($TESTS_IO)}: $*" | tee -a "$failures"
+}
+
+# make_tree dir seed: a tree with files around the block size, nested and empty directories, symlinks, long paths
+# and a non-ASCII name, whose bytes above 127 make the signed and unsigned checksums differ
+make_tree() {
+    root=$1
+    seed=$2
+    mkdir -p "$root/dir/sub/deeper" "$root/dir/empty" "$root/other"
+    for size in 0 1 511 512 513 1000 4096 $((seed * 777 + 10000)); do
+        head -c "$size" /dev/urandom > "$root/dir/f$size"
+    done
+    echo "deep $seed" > "$root/dir/sub/deeper/file"
+    echo "other $seed" > "$root/other/file"
+    echo "accent $seed" > "$root/other/café"
+    ln -s f512 "$root/dir/link_to_file"
+    ln -s dir "$root/link_to_dir"
+    long=$root/dir/sub
+    i=0
+    while [ $i -lt $((seed + 1)) ]; do
+        long=$long/directory_with_a_rather_long_name_$i
+        i=$((i + 1))
+    done
+    mkdir -p "$long"
+    echo "long $seed" > "$long/file_at_the_end_of_a_long_path"
+}
+
+check_archive() {
+    names=$work/names
+    $TAR -P --quoting-style=literal -tf "$archive" > "$names"
+    expected=$(wc -l < "$names")
+    got=$($TESTS "$archive" | sed 's/check_archive returned //')
+    [ "$got" = "$expected" ] || fail "check_archive returned $got, expected $expected"
+
+    $TAR -P --quoting-style=literal -tvf "$archive" | cut -c1 > "$work/types"
+    paste -d ' ' "$work/types" "$names" | while read -r type name; do
+        stat=$($TESTS "$archive" stat "$name")
+        case $type in
+            d) want="exists 1 is_dir 1 is_file 0 is_symlink 0"; want_type=5 ;;
+            -) want="exists 1 is_dir 0 is_file 1 is_symlink 0"; want_type=0 ;;
+            l) want="exists 1 is_dir 0 is_file 0 is_symlink 1"; want_type=2 ;;
+            *) continue ;;
+        esac
+        echo "$stat" | head -n 1 | grep -qx "$want" || fail "$name: $(echo "$stat" | head -n 1), expected $want"
+        echo "$stat" | grep -q "^type $want_type " || fail "$name: tar_stat gave '$(echo "$stat" | sed -n 2p)'"
+        base=${name%/}
+        base=${base##*/}
+        echo "$stat" | grep -qxF "path $name basename $base" || fail "$name: tar_path gave '$(echo "$stat" | sed -n 3p)'"
+        if [ -n "$TESTS_IO" ]; then
+            echo "$stat" | grep -qx "verify 0" || fail "$name: tar_verify gave '$(echo "$stat" | sed -n 4p)'"
+        fi
+
+        if [ "$type" = "-" ]; then
+            $TAR -P -xOf "$archive" "$name" > "$work/expected_content"
+            $TESTS "$archive" cat "$name" > "$work/content" || fail "$name: read_file failed"
+            cmp -s "$work/expected_content" "$work/content" || fail "$name: read_file content differs"
+
+            sha256=$(sha256sum < "$work/expected_content" | cut -d ' ' -f 1)
+            digest=$($TESTS "$archive" digest "$name")
+            echo "$digest" | head -n 1 | grep -q " sha256 $sha256\$" || fail "$name: tar_digest gave '$(echo "$digest" | head -n 1)'"
+            echo "$digest" | grep -qx "verify 0" || fail "$name: tar_verify gave '$(echo "$digest" | sed -n 2p)'"
+            if [ -s "$work/expected_content" ]; then
+                # un octet modifié, puis l'archive coupée au milieu du contenu, sur une copie
+                cp "$archive" "$work/tampered.tar"
+                tamper=$($TESTS "$work/tampered.tar" tamper "$name")
+                [ "$tamper" = "flipped 1 restored 0 padding -5 truncated 1 before 1 reopen -5" ] || fail "$name: tamper gave '$tamper'"
+            fi
+        fi
+
+        if [ "$type" = "d" ]; then
+            # enfants directs : commencent par le répertoire et n'ont plus de / sauf à la fin
+            awk -v dir="$name" 'index($0, dir) == 1 && $0 != dir {
+                rest = substr($0, length(dir) + 1); sub(/\/$/, "", rest); if (rest !~ /\//) print }' "$names" \
+                > "$work/expected_children"
+            $TESTS "$archive" lsi "$name" > "$work/children" || fail "$name: tar_list_begin failed"
+            cmp -s "$work/expected_children" "$work/children" || fail "$name: cursor listing differs"
+            $TESTS "$archive" ls "$name" > "$work/children" || fail "$name: list failed"
+            cmp -s "$work/expected_children" "$work/children" || fail "$name: list differs"
+        fi
+    done
+}
+
+# put file offset bytes: écrit bytes (un format de printf, \ooo pour un octet en octal) à l'offset donné de file
+put() {
+    printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# make_numbers_archive file size_field [typeflag]: une archive d'un fichier "big" de 5 octets écrite à la main, GNU tar n'utilise
+# la base 256 qu'au-delà de 8 Go ou de l'uid 2097151 : uid et size en base 256, gid et mtime précédés d'espaces
+make_numbers_archive() {
+    head -c 512 /dev/zero > "$1"
+    put "$1" 0 'big'
+    put "$1" 100 '0000644'
+    put "$1" 108 '\200\000\000\000\000\055\306\300'     # uid 3000000
+    put "$1" 116 '   1750\000'                             # gid 1000
+    put "$1" 124 "$2"
+    put "$1" 136 '   12345670\000'                         # mtime 2739128
+    put "$1" 148 '        '                                # le checksum se calcule avec des espaces à sa place
+    put "$1" 156 "${3:-0}"
+    put "$1" 257 'ustar\000'
+    put "$1" 263 '00'
+    # somme des octets signés, celle que calcule check_archive (GNU tar accepte aussi les octets signés)
+    sum=$(od -An -tu1 -v "$1" | awk '{ for (i = 1; i <= NF; i++) s += $i > 127 ? $i - 256 : $i } END { print s }')
+    put "$1" 148 "$(printf '%06o' "$sum")\\000 "
+    printf 'hello' >> "$1"
+    head -c $((507 + 1024)) /dev/zero >> "$1"
+}
+
+check_numbers() {
+    archive=$work/numbers.tar
+    make_numbers_archive "$archive" '\200\000\000\000\000\000\000\000\000\000\000\005'
+    got=$($TESTS "$archive")
+    [ "$got" = "check_archive returned 1" ] || fail "$got"
+    stat=$($TESTS "$archive" stat big)
+    echo "$stat" | sed -n 2p | grep -qx "type 0 size 5 mode 644 uid 3000000 gid 1000 mtime 2739128 link " \
+        || fail "big: tar_stat gave '$(echo "$stat" | sed -n 2p)'"
+    [ "$($TESTS "$archive" cat big)" = "hello" ] || fail "big: read_file content differs"
+
+    # typeflag nul (AREGTYPE) des archives pré-POSIX : un fichier standard, pour is_file et read_file comme pour l'index
+    archive=$work/aregtype.tar
+    make_numbers_archive "$archive" '\200\000\000\000\000\000\000\000\000\000\000\005' '\000'
+    stat=$($TESTS "$archive" stat big)
+    echo "$stat" | head -n 1 | grep -qx "exists 1 is_dir 0 is_file 1 is_symlink 0" \
+        || fail "big: $(echo "$stat" | head -n 1), expected a regular file"
+    echo "$stat" | sed -n 2p | grep -q "^type 0 size 5 " || fail "big: tar_stat gave '$(echo "$stat" | sed -n 2p)'"
+    [ "$($TESTS "$archive" cat big)" = "hello" ] || fail "big: read_file content differs"
+
+    archive=$work/negative.tar
+    make_numbers_archive "$archive" '\377\377\377\377\377\377\377\377\377\377\377\377'   # size -1
+    got=$($TESTS "$archive")
+    [ "$got" = "check_archive returned -5" ] || fail "$got"
+    got=$($TESTS "$archive" cat big 2>&1 > /dev/null)
+    [ "$got" = "read_file returned -4" ] || fail "big: read_file gave '$got' for a negative size"
+}
+
+check_numbers
+
+for seed in 1 2 3; do
+    make_tree "$work/tree$seed" $seed
+    archive=$work/archive$seed.tar
+    (cd "$work/tree$seed" && $TAR --format=ustar -cf "$archive" dir link_to_dir other)
+    check_archive
+    # même vérification avec l'index partagé, exporté dans une memfd puis attaché (voir open_index dans tests.c)
+    export TESTS_SHARED_INDEX=1
+    check_archive
+    unset TESTS_SHARED_INDEX
+    # et avec chaque mode de lecture de l'index, dont O_DIRECT et ses lectures alignées (voir open_index dans tests.c)
+    for io in direct dontneed; do
+        export TESTS_IO=$io
+        check_archive
+    done
+    unset TESTS_IO
+    if [ -n "$1" ]; then
+        mkdir -p "$1"
+        cp "$archive" "$1/"
+    fi
+done
+
+# chemins absolus gardés par tar -P : le / du début fait partie du nom, pour list() comme pour l'index
+archive=$work/absolute.tar
+$TAR -P --format=ustar -cf "$archive" "$work/tree1/other" "$work/tree1/dir/sub"
+check_archive
+
+if [ -s "$failures" ]; then
+    echo "difftest: $(wc -l < "$failures") failure(s)"
+    exit 1
+fi
+echo "difftest: ok"
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE /* memfd_create */
+#include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "lib_tar.h"
+
+/**
+ * Fuzz target for the scanners (check_archive, exists, is_*, list, read_file) and the index, built and shared.
+ *
+ * make fuzz              standalone build with ASan/UBSan: ./fuzz corpus_dir_or_files...
+ *                        replays the inputs and prints the scan throughput, also usable with AFL (./fuzz @@)
+ * make fuzz-perf         same driver without sanitizers, its MB/s on a fixed corpus tracks the scan performance
+ * make fuzz-libfuzzer    libFuzzer build (clang): ./fuzz-libfuzzer corpus_dir
+ *
+ * ./difftest.sh corpus_dir generates seed archives with GNU tar.
+ */
+
+#define FUZZ_ENTRIES 16
+
+static int archive_fd = -1;
+
+/* Paths to look up: a few fixed ones and the names found in the headers of the input. */
+static size_t fuzz_paths(const uint8_t *data, size_t size, char paths[][TAR_PATH_MAX + 1], size_t max) {
+    static const char *fixed[] = { "", "dir/", "dir/a", "lnk", "dir" };
+    size_t n = 0;
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]) && n < max; i++) {
+        strcpy(paths[n++], fixed[i]);
+    }
+    for (size_t off = 0; off + 512 <= size && n < max; off += 512) {
+        const tar_header_t *header = (const tar_header_t *) (data + off);
+        size_t len = strnlen(header->name, sizeof(header->name));
+        if (len > 0) {
+            memcpy(paths[n], header->name, len);
+            paths[n++][len] = '\0';
+        }
+    }
+    return n;
+}
+
+static void fuzz_queries(tar_index_t *index, char paths[][TAR_PATH_MAX + 1], size_t nb_paths) {
+    for (size_t i = 0; i < nb_paths; i++) {
+        struct tar_stat st;
+        struct tar_stat entries[FUZZ_ENTRIES];
+        size_t no_entries = FUZZ_ENTRIES;
+        tar_readdir_plus(index, paths[i], entries, &no_entries);
+        int verified = tar_verify(index, paths[i]);
+        if (verified != 0 && verified != -1) {//l'archive n'a pas changé depuis la construction de l'index
+            abort();
+        }
+        if (tar_stat(index, paths[i], &st) == 0) {
+            char path[TAR_PATH_MAX + 1];
+            tar_path(index, st.entry, path);
+        }
+
+        tar_cursor_t cursor;
+        static char batch_buf[FUZZ_ENTRIES][TAR_PATH_MAX + 1];
+        char *batch[FUZZ_ENTRIES];
+        for (size_t j = 0; j < FUZZ_ENTRIES; j++) {
+            batch[j] = batch_buf[j];
+        }
+        if (tar_list_begin(index, paths[i], &cursor) >= 0) {
+            while (tar_list_next(&cursor, batch, FUZZ_ENTRIES) > 0) {
+            }
+        }
+    }
+}
+
+/* The index built from the input with the given flags, then the same index exported to a memfd and attached. */
+static void fuzz_index(int fd, int flags, char paths[][TAR_PATH_MAX + 1], size_t nb_paths) {
+    static int shm_fd = -1;
+    if (shm_fd == -1) {
+        shm_fd = memfd_create("fuzz.idx", 0);//sans MFD_ALLOW_SEALING, pour la réutiliser à chaque entrée
+        if (shm_fd == -1) {
+            abort();
+        }
+    }
+    tar_index_t *index;
+    if (tar_index_open(fd, flags, &index) < 0) {
+        return;
+    }
+    fuzz_queries(index, paths, nb_paths);
+    int ret = tar_index_export(index, shm_fd);
+    tar_index_close(index);
+    if (ret != 0 || tar_index_attach(fd, shm_fd, &index) < 0) {
+        abort();//un index qui vient d'être exporté doit pouvoir être attaché
+    }
+    fuzz_queries(index, paths, nb_paths);
+    tar_index_close(index);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (archive_fd == -1) {
+        archive_fd = memfd_create("fuzz.tar", 0);
+        if (archive_fd == -1) {
+            abort();
+        }
+    }
+    if (ftruncate(archive_fd, 0) == -1 || pwrite(archive_fd, data, size, 0) != (ssize_t) size) {
+        abort();
+    }
+
+    static char paths[32][TAR_PATH_MAX + 1];
+    size_t nb_paths = fuzz_paths(data, size, paths, 32);
+
+    check_archive(archive_fd);
+    static char entry_buf[FUZZ_ENTRIES][TAR_PATH_MAX + 1];
+    char *entries[FUZZ_ENTRIES];
+    for (size_t i = 0; i < FUZZ_ENTRIES; i++) {
+        entries[i] = entry_buf[i];
+    }
+    for (size_t i = 0; i < nb_paths; i++) {
+        exists(archive_fd, paths[i]);
+        is_dir(archive_fd, paths[i]);
+        is_file(archive_fd, paths[i]);
+        is_symlink(archive_fd, paths[i]);
+        size_t no_entries = FUZZ_ENTRIES;
+        list(archive_fd, paths[i], entries, &no_entries);
+        uint8_t dest[700];
+        size_t len = sizeof(dest);
+        read_file(archive_fd, paths[i], 3, dest, &len);
+    }
+    fuzz_index(archive_fd, TAR_HASH_CRC32C, paths, nb_paths);
+    fuzz_index(archive_fd, TAR_HASH_CRC32C | TAR_IO_DIRECT, paths, nb_paths);//relectures alignées, fin avant le curseur
+    return 0;
+}
+
+#ifndef LIBFUZZER
+
+static size_t total_bytes = 0;
+static size_t total_inputs = 0;
+
+static void run_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return;
+    }
+    uint8_t *data = malloc(st.st_size ? st.st_size : 1);
+    ssize_t rd = read(fd, data, st.st_size);
+    close(fd);
+    if (rd == st.st_size) {
+        LLVMFuzzerTestOneInput(data, rd);
+        total_bytes += rd;
+        total_inputs++;
+    }
+    free(data);
+}
+
+static void run_path(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        run_file(path);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        run_path(child);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %s corpus_dir_or_file...\n", argv[0]);
+        return -1;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 1; i < argc; i++) {
+        run_path(argv[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    fprintf(stderr, "fuzz: %zu inputs  %zu bytes  %.3f s  %.1f MB/s\n", total_inputs, total_bytes, elapsed,
+            total_bytes / elapsed / 1e6);
+    return 0;
+}
+
+#endif
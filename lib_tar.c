@@ -1,12 +1,212 @@
 #include "lib_tar.h"
 
+#define ONES8   0x0101010101010101ULL
+#define MAX_SYMLINKS 40   /* nombre de liens suivis avant de conclure à une boucle, comme Linux */
+
+/*
+ * Charge jusqu'à 8 octets du champ dans un mot, l'octet field[0] dans les bits de poids faible
+ * quel que soit l'endianness de la machine.
+ */
+static inline uint64_t load_le(const char *field, size_t n) {
+    if (n == 8) {//taille constante : une seule instruction de chargement
+        uint64_t w;
+        memcpy(&w, field, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        return w;
+    }
+    if (n == 4) {//fin des champs de 12 octets
+        uint32_t w;
+        memcpy(&w, field, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap32(w);
+#endif
+        return w;
+    }
+    uint64_t w = 0;
+    for (size_t i = 0; i < n; i++) {
+        w |= (uint64_t) (unsigned char) field[i] << (8 * i);
+    }
+    return w;
+}
+
+/*
+ * Décode un bloc de n<=8 octets en octal (SWAR), met dans *ndigits le nombre de chiffres lus
+ * (on s'arrête au premier octet qui n'est pas entre '0' et '7').
+ */
+static inline uint64_t octal_chunk(const char *field, size_t n, int *ndigits) {
+    uint64_t w = load_le(field, n);
+    //un octet est un chiffre octal ssi ses 5 bits de poids fort valent 00110
+    uint64_t bad = (w & (0xF8 * ONES8)) ^ (0x30 * ONES8);
+    if (n < 8) {
+        bad |= ~0ULL << (8 * n);//les octets hors du champ arrêtent le décodage
+    }
+    int k = bad ? __builtin_ctzll(bad) / 8 : 8;
+    *ndigits = k;
+    if (k == 0) {
+        return 0;
+    }
+    uint64_t d = w - 0x30 * ONES8;
+    if (k < 8) {
+        d &= (1ULL << (8 * k)) - 1;
+        d <<= 8 * (8 - k);//on aligne à droite : les chiffres manquants deviennent des zéros de tête
+    }
+    //on combine les chiffres deux par deux, puis les paires, puis les quadruplets
+    d = ((d << 3) + (d >> 8)) & (0xFF * 0x0001000100010001ULL);
+    d = ((d << 6) + (d >> 16)) & 0x0000FFFF0000FFFFULL;
+    d = ((d << 12) + (d >> 32)) & 0xFFFFFFFFULL;
+    return d;
+}
+
+/**
+ * Parses a numeric field of a tar header.
+ *
+ * @param field A pointer to the start of the field.
+ * @param len The size of the field in bytes, at most len bytes are read.
+ *
+ * @return the value of the field, zero if the field does not start with a digit.
+ */
+int64_t tar_parse_int(const char *field, size_t len) {
+    const unsigned char *bytes = (const unsigned char *) field;
+    if (len == 0) {
+        return 0;
+    }
+    if (bytes[0] & 0x80) {//encodage base-256 : 0x80 pour un positif, 0xff pour un négatif (complément à deux)
+        uint64_t v = (bytes[0] & 0x40) ? ~0ULL : 0;
+        v = (v << 8) | (bytes[0] & 0x40 ? bytes[0] : (bytes[0] & 0x7f));
+        for (size_t i = 1; i < len; i++) {
+            v = (v << 8) | bytes[i];
+        }
+        return (int64_t) v;
+    }
+    size_t i = 0;
+    while (i < len && bytes[i] == ' ') {//certaines archives alignent les nombres avec des espaces
+        i++;
+    }
+    uint64_t v = 0;
+    while (i < len) {
+        size_t n = len - i < 8 ? len - i : 8;
+        int k;
+        uint64_t chunk = octal_chunk(field + i, n, &k);
+        v = (v << (3 * k)) | chunk;
+        if (k < 8) {
+            break;
+        }
+        i += 8;
+    }
+    return (int64_t) v;
+}
+
+/*
+ * Écrit dans path le chemin complet de l'entrée (prefix/name en ustar) terminé par un null, retourne sa longueur.
+ * path doit pouvoir contenir TAR_PATH_MAX+1 octets, name et prefix ne sont pas forcément terminés par un null.
+ */
+static size_t header_path(const tar_header_t *header, char *path) {
+    size_t len = 0;
+    size_t prefix_len = strnlen(header->prefix, sizeof(header->prefix));
+    if (prefix_len > 0) {
+        memcpy(path, header->prefix, prefix_len);
+        path[prefix_len] = '/';
+        len = prefix_len + 1;
+    }
+    size_t name_len = strnlen(header->name, sizeof(header->name));
+    memcpy(path + len, header->name, name_len);
+    len += name_len;
+    path[len] = '\0';
+    return len;
+}
+
+/*
+ * Compare le chemin de l'entrée à path.
+ */
+static bool name_is(const tar_header_t *header, const char *path) {
+    char full[TAR_PATH_MAX + 1];
+    size_t len = header_path(header, full);
+    return strlen(path) == len && memcmp(full, path, len) == 0;
+}
+
+/*
+ * Vérifie que le chemin de l'entrée commence par path.
+ */
+static bool name_starts_with(const tar_header_t *header, const char *path) {
+    char full[TAR_PATH_MAX + 1];
+    size_t len = strlen(path);
+    return len <= header_path(header, full) && memcmp(full, path, len) == 0;
+}
+
+/*
+ * Fichier standard : typeflag REGTYPE, ou AREGTYPE dans les vieilles archives (l'index les confond aussi).
+ */
+static bool is_regular(const tar_header_t *header) {
+    return header->typeflag == REGTYPE || header->typeflag == AREGTYPE;
+}
+
+/*
+ * Copie le champ linkname dans une nouvelle chaîne, avec de la place pour un / en plus.
+ */
+static char *linkname_dup(const tar_header_t *header) {
+    size_t len = strnlen(header->linkname, sizeof(header->linkname));
+    char *name = malloc(len + 2);
+    if (name != NULL) {
+        memcpy(name, header->linkname, len);
+        name[len] = '\0';
+    }
+    return name;
+}
+
+/*
+ * Place tar_fd sur le header qui suit celui qu'on vient de lire.
+ * Retourne -1 si la taille est négative (archive corrompue) ou si lseek échoue.
+ * Au-delà de la fin du fichier, c'est le read suivant qui échoue.
+ */
+static off_t skip_content(int tar_fd, const tar_header_t *header) {
+    int64_t size = TAR_INT(header->size);
+    if (size < 0 || size > INT64_MAX - 511) {//sinon on pourrait revenir en arrière et boucler
+        return -1;
+    }
+    return lseek(tar_fd, (size + 511) / 512 * 512, SEEK_CUR);
+}
+
+/**
+ * Checks the magic value, the version value and the checksum of a non-null header.
+ *
+ * @param header The header to check.
+ *
+ * @return zero if the header is valid, otherwise -1, -2 or -3 as check_archive.
+ */
+int tar_check_header(const tar_header_t *header) {
+    if (memcmp(header->magic, TMAGIC, TMAGLEN) != 0) {
+        return -1;
+    }
+    if (memcmp(header->version, TVERSION, TVERSLEN) != 0) {
+        return -2;
+    }
+    int64_t checksum = 0;//octets non signés (POSIX)
+    int64_t checksum_signed = 0;//octets signés, comme les vieux tar
+    const unsigned char *bytes = (const unsigned char *) header;
+    for (size_t i = 0; i < sizeof(tar_header_t); i++) {
+        checksum += bytes[i];
+        checksum_signed += (signed char) bytes[i];
+    }
+    for (size_t i = 0; i < sizeof(header->chksum); i++) {//le checksum se calcule avec des espaces à la place de lui-même
+        checksum += ' ' - (unsigned char) header->chksum[i];
+        checksum_signed += ' ' - (signed char) header->chksum[i];
+    }
+    int64_t checksum_true = TAR_INT(header->chksum);
+    if (checksum_true != checksum && checksum_true != checksum_signed) {
+        return -3;
+    }
+    return 0;
+}
+
 /**
  * Checks whether the archive is valid.
  *
  * Each non-null header of a valid archive has:
  *  - a magic value of "ustar" and a null,
  *  - a version value of "00" and no null,
- *  - a correct checksum
+ *  - a correct checksum, summed over signed or unsigned bytes
  *
  * @param tar_fd A file descriptor pointing to the start of a file supposed to contain a tar archive.
  *
@@ -15,6 +215,7 @@
  *         -2 if the archive contains a header with an invalid version value,
  *         -3 if the archive contains a header with an invalid checksum value
  *         -4 problème avec une fonction interne(read ou malloc)
+ *         -5 archive tronquée ou taille d'un header invalide
  */
 int check_archive(int tar_fd) {//correct
     int nb_headers = 0;//commence à 0 parce que contient tj un header null pour spécifier la fin de l'archive
@@ -22,12 +223,15 @@ int check_archive(int tar_fd) {//correct
     lseek(tar_fd,0,SEEK_SET);
     while (nb_zero<2) {
         tar_header_t *header =(tar_header_t*) malloc(512);
-        size_t rd= read(tar_fd, header, sizeof(tar_header_t));
+        ssize_t rd= read(tar_fd, header, sizeof(tar_header_t));
         if(rd==-1||header==NULL){
             free(header);
-            printf("erreur dans read ou malloc");
             return -4;
         }
+        if(rd<512){//fin du fichier avant les deux blocs vides
+            free(header);
+            return -5;
+        }
 
         //on vérifie si le bloc est vide
         int isZero = 1;
@@ -40,41 +244,22 @@ int check_archive(int tar_fd) {//correct
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
-        //Verifie la magic value
-        if(strncmp(header->magic, TMAGIC, TMAGLEN) != 0) {
-            free(header);
-            return -1;
-        }
-
-        //Verifie la version value
-        if (strncmp(header->version, TVERSION, TVERSLEN) != 0) {
+        //magic, version et checksum (octets signés ou non signés)
+        int ret = tar_check_header(header);
+        if (ret != 0) {
             free(header);
-            return -2;
-        }
-
-        //On vérifie la checksum
-        int checksum = 0;
-        int checksum_true = TAR_INT(header->chksum);
-        for(int i = 0;i<8;i++){// on remplace les bits de checksum par des espaces car lorsque que checksum est calculé il ne connait pas sa propre valeur
-            header->chksum[i]=' ';
-        }
-        for (size_t i = 0; i < sizeof(tar_header_t); i++) {
-            checksum += ((char*) header)[i];
-        }
-        if (checksum_true != checksum) {
-            free(header);
-            return -3;
+            return ret;
         }
         //On passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
+        if(skip_content(tar_fd,header)==-1){//taille négative ou hors du fichier
+            free(header);
+            return -5;
         }
-        lseek(tar_fd,size,SEEK_CUR);
         free(header);
         nb_headers++;
     }
@@ -95,7 +280,7 @@ int exists(int tar_fd, char *path) {//est ce qu'on doit trouver un fichier dans
     int nb_zero=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
         if(rd<512||header==NULL){
             free(header);
             return -4;
@@ -112,20 +297,18 @@ int exists(int tar_fd, char *path) {//est ce qu'on doit trouver un fichier dans
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
-        if(strcmp(header->name,path)==0){
+        if(name_is(header,path)){
+            free(header);
             return 1;//on a trouvé le fichier
         }
         //si c'est on trouve un directory et qu'on doit les gérer il faudrait sauvegarder dir/ et relancer la recherche sur dir/path
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             return -4;
         }
@@ -148,7 +331,7 @@ int is_dir(int tar_fd, char *path) {
     int nb_zero=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
         if(rd<512||header==NULL){
             free(header);
             return -4;
@@ -164,12 +347,13 @@ int is_dir(int tar_fd, char *path) {
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
 
-        if(strcmp(header->name,path)==0){//on a trouvé le fichier, format d'un directory: path=dir/
+        if(name_is(header,path)){//on a trouvé le fichier, format d'un directory: path=dir/
             if(header->typeflag==DIRTYPE){
                 free(header);
                 return 1;//le fichier est bien un directory
@@ -180,11 +364,7 @@ int is_dir(int tar_fd, char *path) {
         }
 
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             return -4;
         }
@@ -207,10 +387,9 @@ int is_file(int tar_fd, char *path) {
     int nb_zero=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
         if(rd<512||header==NULL){
             free(header);
-            printf("erreur avec read ou malloc");
             return -4;
         }
         //on vérifie si le bloc est vide
@@ -224,12 +403,13 @@ int is_file(int tar_fd, char *path) {
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
-        if(strcmp(header->name,path)==0){//on a trouvé le fichier
-            if(header->typeflag==REGTYPE){
+        if(name_is(header,path)){//on a trouvé le fichier
+            if(is_regular(header)){
                 free(header);
                 return 1;//le fichier est bien un fichier standart
             }else{
@@ -239,11 +419,7 @@ int is_file(int tar_fd, char *path) {
         }
 
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             return -4;
         }
@@ -265,10 +441,9 @@ int is_symlink(int tar_fd, char *path) {
     int nb_zero=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
         if(rd<512||header==NULL){
             free(header);
-            printf("erreur avec read ou malloc");
             return -4;
         }
         //on vérifie si le bloc est vide
@@ -282,11 +457,12 @@ int is_symlink(int tar_fd, char *path) {
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
         
-        if(strcmp(header->name,path)==0){//on a trouvé le fichier
+        if(name_is(header,path)){//on a trouvé le fichier
             if(header->typeflag==SYMTYPE){
                 free(header);
                 return 1;//le fichier est bien un symlink
@@ -297,11 +473,7 @@ int is_symlink(int tar_fd, char *path) {
         }
 
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             return -4;
         }
@@ -311,43 +483,25 @@ int is_symlink(int tar_fd, char *path) {
     return 0;
 }
 
-/**
- * Lists the entries at a given path in the archive.
- * list() does not recurse into the directories listed at the given path.
- *
- * Example:
- *  dir/          list(..., "dir/", ...) lists "dir/a", "dir/b", "dir/c/" and "dir/e/"
- *   ├── a
- *   ├── b
- *   ├── c/
- *   │   └── d
- *   └── e/
- *
- * @param tar_fd A file descriptor pointing to the start of a valid tar archive file.
- * @param path A path to an entry in the archive. If the entry is a symlink, it must be resolved to its linked-to entry.
- * @param entries An array of char arrays, each one is long enough to contain a tar entry path.
- * @param no_entries An in-out argument.
- *                   The caller set it to the number of entries in `entries`.
- *                   The callee set it to the number of entries listed.
- *
- * @return zero if no directory at the given path exists in the archive,
- *         any other value otherwise.
+/*
+ * list() avec le nombre de liens symboliques déjà suivis, pour s'arrêter sur une boucle de liens.
  */
-int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
+static int list_depth(int tar_fd, char *path, char **entries, size_t *no_entries, int depth) {
     int tar_fd_init=tar_fd;
     if(lseek(tar_fd,0,SEEK_SET)==-1){return -4;}
     int nb_zero=0;
     bool find = false;
-    char *previous =(char*) malloc(100);// un name fait 100 
-    *previous=' ';
+    char *previous =(char*) malloc(TAR_PATH_MAX+1);// un chemin fait au plus 256, plus le null
+    if(previous==NULL){return -4;}
+    strcpy(previous," ");
     int i=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
 
         if(rd<512||header==NULL){
             free(header);
-            printf("erreur avec read ou malloc");
+            free(previous);
             return -4;
         }
         //on vérifie si le bloc est vide
@@ -361,22 +515,23 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
         if(find){
-            if(strncmp(header->name,path,strlen(path))==0&&strncmp(header->name,previous,strlen(previous))!=0){//on vérifie si on le header commence par dir/
+            if(name_starts_with(header,path)&&!name_starts_with(header,previous)){//on vérifie si on le header commence par dir/
                 if(header->typeflag==DIRTYPE){
-                    strcpy(previous,header->name);//on ne veut pas prendre les éléments de ce sous-dossier
+                    header_path(header,previous);//on ne veut pas prendre les éléments de ce sous-dossier
                 }
                 if(i==*no_entries){
                     free(header);
                     break;
                 }
-                strcpy(entries[i],header->name);
+                header_path(header,entries[i]);
                 i++;
-            }if(strncmp(header->name,path,strlen(path))!=0){
+            }if(!name_starts_with(header,path)){
                 free(header);
                 free(previous);
                 *no_entries=i;
@@ -384,16 +539,23 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
             }
         }
 
-        if(strcmp(header->name,path)==0&&!find){//on a trouvé le fichier
+        if(name_is(header,path)&&!find){//on a trouvé le fichier
             if(header->typeflag==DIRTYPE){
                 find=true;
             }else if(header->typeflag==SYMTYPE){
-                char *name = malloc(strlen(header->linkname) + 2);
-                strcpy(name,header->linkname);
-                strcat(name,"/");
+                char *name = linkname_dup(header);
                 free(header);
                 free(previous);
-                return list(tar_fd_init,name,entries,no_entries);//on relance la recherhe
+                if(name==NULL){return -4;}
+                if(depth>=MAX_SYMLINKS){//boucle de liens
+                    free(name);
+                    *no_entries=0;
+                    return 0;
+                }
+                strcat(name,"/");
+                int ret = list_depth(tar_fd_init,name,entries,no_entries,depth+1);//on relance la recherhe
+                free(name);
+                return ret;
 
             }else{
                 free(header);
@@ -403,11 +565,7 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
             }
         }
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             free(previous);
             *no_entries=i;
@@ -417,36 +575,46 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
     }
     *no_entries=i;
     free(previous);
-    return 0;
+    return find;//le répertoire peut être le dernier de l'archive
 }
 
 /**
- * Reads a file at a given path in the archive.
+ * Lists the entries at a given path in the archive.
+ * list() does not recurse into the directories listed at the given path.
  *
- * @param tar_fd A file descriptor pointing to the start of a valid tar archive file.
- * @param path A path to an entry in the archive to read from.  If the entry is a symlink, it must be resolved to its linked-to entry.
- * @param offset An offset in the file from which to start reading from, zero indicates the start of the file.
- * @param dest A destination buffer to read the given file into.
- * @param len An in-out argument.
- *            The caller set it to the size of dest.
- *            The callee set it to the number of bytes written to dest.
+ * Example:
+ *  dir/          list(..., "dir/", ...) lists "dir/a", "dir/b", "dir/c/" and "dir/e/"
+ *   ├── a
+ *   ├── b
+ *   ├── c/
+ *   │   └── d
+ *   └── e/
  *
- * @return -1 if no entry at the given path exists in the archive or the entry is not a file,
- *         -2 if the offset is outside the file total length,
- *         zero if the file was read in its entirety into the destination buffer,
- *         a positive value if the file was partially read, representing the remaining bytes left to be read to reach
- *         the end of the file.
+ * @param tar_fd A file descriptor pointing to the start of a valid tar archive file.
+ * @param path A path to an entry in the archive. If the entry is a symlink, it must be resolved to its linked-to entry.
+ * @param entries An array of char arrays, each one is long enough to contain a tar entry path.
+ * @param no_entries An in-out argument.
+ *                   The caller set it to the number of entries in `entries`.
+ *                   The callee set it to the number of entries listed.
  *
+ * @return zero if no directory at the given path exists in the archive,
+ *         any other value otherwise.
  */
-ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *len) {
+int list(int tar_fd, char *path, char **entries, size_t *no_entries) {
+    return list_depth(tar_fd, path, entries, no_entries, 0);
+}
+
+/*
+ * read_file() avec le nombre de liens symboliques déjà suivis, pour s'arrêter sur une boucle de liens.
+ */
+static ssize_t read_file_depth(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *len, int depth) {
     if(lseek(tar_fd,0,SEEK_SET)==-1){return -4;}
     int nb_zero=0;
     while(nb_zero<2){
         tar_header_t *header = (tar_header_t*) malloc(512);
-        size_t rd = read(tar_fd,header,sizeof(tar_header_t));
+        ssize_t rd = read(tar_fd,header,sizeof(tar_header_t));
         if(rd<512||header==NULL){
             free(header);
-            printf("erreur avec read ou malloc");
             return -4;
         }
         //on vérifie si le bloc est vide
@@ -460,17 +628,24 @@ ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *
             }
         }
         if (isZero){
+            free(header);
             nb_zero++;
             continue;
         }
 
-        if(strcmp(header->name,path)==0){//on a trouvé le fichier
-            if(header->typeflag==REGTYPE){//le fichier est bien un fichier standart
-                if(offset>TAR_INT(header->size)){//offset trop loin
+        if(name_is(header,path)){//on a trouvé le fichier
+            if(is_regular(header)){//le fichier est bien un fichier standart
+                int64_t size = TAR_INT(header->size);//on ne décode la taille qu'une fois
+                if(size<0){//taille base-256 négative : archive corrompue, comme dans skip_content
+                    free(header);
+                    return -4;
+                }
+                size_t file_size = size;
+                if(offset>file_size){//offset trop loin
                     free(header);
                     return -2;
                 }else{
-                    size_t readbytes = TAR_INT(header->size)-offset;//nombre de bits à lire
+                    size_t readbytes = file_size-offset;//nombre de bits à lire
                     if(readbytes>*len){//buffer pas assez grand
                         lseek(tar_fd,offset,SEEK_CUR);
                         rd = read(tar_fd,dest,*len);
@@ -479,7 +654,8 @@ ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *
                             return -3;
                         }
                         free(header);
-                        return readbytes-*len;
+                        *len=rd;//archive tronquée : on ne donne que ce qui a été lu
+                        return readbytes-rd;
                     }else{
                         lseek(tar_fd,offset,SEEK_CUR);
                         rd = read(tar_fd,dest,readbytes);
@@ -488,26 +664,28 @@ ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *
                             return -3;
                         }
                         free(header);
-                        *len=readbytes;
-                        return 0;
+                        *len=rd;
+                        return readbytes-rd;
                     }
                 }
             }if(header->typeflag==SYMTYPE){
-                char *name = malloc(strlen(header->linkname) + 2);
-                strcpy(name,header->linkname);
+                char *name = linkname_dup(header);
                 free(header);
-                return read_file(tar_fd,name,offset,dest,len);//on relance
+                if(name==NULL){return -4;}
+                if(depth>=MAX_SYMLINKS){//boucle de liens
+                    free(name);
+                    return -1;
+                }
+                ssize_t ret = read_file_depth(tar_fd,name,offset,dest,len,depth+1);//on relance
+                free(name);
+                return ret;
             }else{//le fichier n'est pas un fichier standart
                 free(header);
                 return -1;
             }
         }
         //passe au header suivant
-        size_t size = TAR_INT(header->size);
-        if (size % 512){
-            size += 512 - (size % 512);
-        }
-        if(lseek(tar_fd,size,SEEK_CUR)==-1){
+        if(skip_content(tar_fd,header)==-1){
             free(header);
             return -4;
         }
@@ -516,3 +694,25 @@ ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *
     return -1;
 }
 
+/**
+ * Reads a file at a given path in the archive.
+ *
+ * @param tar_fd A file descriptor pointing to the start of a valid tar archive file.
+ * @param path A path to an entry in the archive to read from.  If the entry is a symlink, it must be resolved to its linked-to entry.
+ * @param offset An offset in the file from which to start reading from, zero indicates the start of the file.
+ * @param dest A destination buffer to read the given file into.
+ * @param len An in-out argument.
+ *            The caller set it to the size of dest.
+ *            The callee set it to the number of bytes written to dest.
+ *
+ * @return -1 if no entry at the given path exists in the archive or the entry is not a file,
+ *         -2 if the offset is outside the file total length,
+ *         -4 if there was a problem in a fonction or the archive contains a header with an invalid size,
+ *         zero if the file was read in its entirety into the destination buffer,
+ *         a positive value if the file was partially read, representing the remaining bytes left to be read to reach
+ *         the end of the file.
+ *
+ */
+ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *len) {
+    return read_file_depth(tar_fd, path, offset, dest, len, 0);
+}
@@ -40,6 +40,9 @@ typedef struct posix_header
 #define TVERSION "00"           /* 00 and no null */
 #define TVERSLEN 2
 
+/* Maximum length of the path of an entry: prefix, '/' and name (without the null) */
+#define TAR_PATH_MAX 256
+
 /* Values used in typeflag field.  */
 #define REGTYPE  '0'            /* regular file */
 #define AREGTYPE '\0'           /* regular file */
@@ -47,8 +50,32 @@ typedef struct posix_header
 #define SYMTYPE  '2'            /* reserved */
 #define DIRTYPE  '5'            /* directory */
 
-/* Converts an ASCII-encoded octal-based number into a regular integer */
-#define TAR_INT(char_ptr) strtol(char_ptr, NULL, 8)
+/* Converts an ASCII-encoded octal-based number into a regular integer.
+ * The argument must be one of the fixed-size fields of tar_header_t, the parsing never goes past its end. */
+#define TAR_INT(field) tar_parse_int(field, sizeof(field))
+
+/**
+ * Parses a numeric field of a tar header.
+ *
+ * The field is either ASCII-encoded octal (leading spaces allowed, ended by a null, a space or the end of the field)
+ * or, if the high bit of its first byte is set, the GNU base-256 big-endian binary encoding.
+ *
+ * @param field A pointer to the start of the field.
+ * @param len The size of the field in bytes, at most len bytes are read.
+ *
+ * @return the value of the field, zero if the field does not start with a digit.
+ */
+int64_t tar_parse_int(const char *field, size_t len);
+
+/**
+ * Checks the magic value, the version value and the checksum of a non-null header.
+ * The checksum may be summed over signed or unsigned bytes, tar implementations disagree.
+ *
+ * @param header The header to check.
+ *
+ * @return zero if the header is valid, otherwise -1, -2 or -3 as check_archive.
+ */
+int tar_check_header(const tar_header_t *header);
 
 /**
  * Checks whether the archive is valid.
@@ -56,7 +83,7 @@ typedef struct posix_header
  * Each non-null header of a valid archive has:
  *  - a magic value of "ustar" and a null,
  *  - a version value of "00" and no null,
- *  - a correct checksum
+ *  - a correct checksum, summed over signed or unsigned bytes
  *
  * @param tar_fd A file descriptor pointing to the start of a file supposed to contain a tar archive.
  *
@@ -65,7 +92,7 @@ typedef struct posix_header
  *         -2 if the archive contains a header with an invalid version value,
  *         -3 if the archive contains a header with an invalid checksum value
  *         -4 if there was a problem in a fonction
- *         -5 if the file do not contain a tar archive
+ *         -5 if the file do not contain a tar archive (truncated archive or header with an invalid size)
  */
 int check_archive(int tar_fd);
 
@@ -128,7 +155,7 @@ int is_symlink(int tar_fd, char *path);
  *
  * @param tar_fd A file descriptor pointing to the start of a valid tar archive file.
  * @param path A path to an entry in the archive. If the entry is a symlink, it must be resolved to its linked-to entry.
- * @param entries An array of char arrays, each one is long enough to contain a tar entry path.
+ * @param entries An array of char arrays, each one is long enough to contain a tar entry path (TAR_PATH_MAX+1 bytes).
  * @param no_entries An in-out argument.
  *                   The caller set it to the number of entries in `entries`.
  *                   The callee set it to the number of entries listed.
@@ -151,6 +178,7 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries);
  *
  * @return -1 if no entry at the given path exists in the archive or the entry is not a file,
  *         -2 if the offset is outside the file total length,
+ *         -4 if there was a problem in a fonction or the archive contains a header with an invalid size,
  *         zero if the file was read in its entirety into the destination buffer,
  *         a positive value if the file was partially read, representing the remaining bytes left to be read to reach
  *         the end of the file.
@@ -158,4 +186,203 @@ int list(int tar_fd, char *path, char **entries, size_t *no_entries);
  */
 ssize_t read_file(int tar_fd, char *path, size_t offset, uint8_t *dest, size_t *len);
 
+/* Index of an archive, built by a single scan (see tar_index.c) */
+typedef struct tar_index tar_index_t;
+
+/* Metadata of an entry, decoded from its header */
+struct tar_stat {
+    const char *basename;   /* last component of the path, without the trailing /, valid until tar_index_close() */
+    uint32_t entry;         /* identifier of the entry in the index, tar_path() gives its full path */
+    const char *linkname;   /* target of a link, "" otherwise, valid until tar_index_close() */
+    uint64_t offset;        /* offset of the content of the entry in the archive */
+    uint64_t size;
+    int64_t mtime;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    char typeflag;
+};
+
+/* Flags of tar_index_open(): digests of the content of each entry computed during the scan */
+#define TAR_HASH_CRC32C  0x1
+#define TAR_HASH_XXH64   0x2
+#define TAR_HASH_SHA256  0x4
+
+/* Flags of tar_index_open(): how the archive is read by the index, for bulk scans that should not fill the page cache */
+#define TAR_IO_DIRECT    0x10   /* read with O_DIRECT and aligned buffers, falls back to TAR_IO_DONTNEED if not supported */
+#define TAR_IO_DONTNEED  0x20   /* drop the pages from the page cache behind the read cursor */
+
+/* Digests of the content of an entry, the ones not computed are zero */
+struct tar_digest {
+    uint32_t crc32c;
+    uint64_t xxh64;
+    uint8_t sha256[32];
+};
+
+/**
+ * Builds the index of an archive by scanning it once.
+ *
+ * The archive is checked like check_archive(), with the same return values.
+ * If the same path appears several times in the archive, the last entry wins.
+ * With TAR_HASH_* flags, the content of every entry is read and hashed in the same pass.
+ * The TAR_IO_* flags apply to this scan and to the later reads of the index (tar_verify()).
+ *
+ * @param tar_fd A file descriptor pointing to a tar archive file. It must stay open until tar_index_close().
+ * @param flags A combination of TAR_HASH_* and TAR_IO_* values, or zero.
+ * @param index An out argument, set to the new index on success.
+ *
+ * @return a zero or positive value on success, representing the number of entries in the index,
+ *         -1 if the archive contains a header with an invalid magic value,
+ *         -2 if the archive contains a header with an invalid version value,
+ *         -3 if the archive contains a header with an invalid checksum value
+ *         -4 if there was a problem in a fonction
+ *         -5 if the archive is truncated (it ends before the two zero blocks or inside the content of an entry)
+ *            or contains a header with an invalid size
+ */
+int tar_index_open(int tar_fd, int flags, tar_index_t **index);
+
+/**
+ * Frees an index built by tar_index_open().
+ */
+void tar_index_close(tar_index_t *index);
+
+/**
+ * Gets the memory used by an index, in bytes.
+ * For an index attached with tar_index_attach(), this is the shared region, counted once for all the processes.
+ */
+size_t tar_index_size(const tar_index_t *index);
+
+/**
+ * Copies an index into a shared memory region, so that other processes can use it without building it again.
+ *
+ * The region holds no pointers, only offsets, and can be mapped at any address. It is written with pwrite(), never
+ * through a mapping, and a memfd created with MFD_ALLOW_SEALING is sealed against any later change.
+ * The header of the region is cleared first and its magic value written last, so a process that attaches while
+ * the export runs gets -6, even when a previous export is overwritten. The processes attached to a previous export
+ * see its pages change under them, they must detach before the region is exported to again.
+ *
+ * @param index An index built by tar_index_open().
+ * @param shm_fd A file descriptor open for writing, from memfd_create() or on a regular file.
+ *
+ * @return zero on success,
+ *         -4 if there was a problem in a fonction
+ */
+int tar_index_export(tar_index_t *index, int shm_fd);
+
+/**
+ * Attaches read-only to an index copied into a shared memory region by tar_index_export().
+ *
+ * The region is mapped with MAP_SHARED: nothing is read from the archive or copied, all the processes attached to
+ * the same region share its pages. The region is trusted, only its header is checked, against the archive (device,
+ * inode, size and mtime), so a modified archive is refused. It uses the flags given to tar_index_open().
+ * The attached index is used and freed like one built by tar_index_open().
+ *
+ * @param tar_fd A file descriptor pointing to the tar archive of the index. It must stay open until tar_index_close().
+ * @param shm_fd A file descriptor of the region, it can be closed once this function returns.
+ * @param index An out argument, set to the attached index on success.
+ *
+ * @return a zero or positive value on success, representing the number of entries in the index,
+ *         -4 if there was a problem in a fonction
+ *         -6 if the region does not hold an index of this archive
+ */
+int tar_index_attach(int tar_fd, int shm_fd, tar_index_t **index);
+
+/**
+ * Gets the metadata of an entry of the archive.
+ * The lookup takes one hash probe per component of the path, "dir" and "dir/" both find a directory.
+ * A symlink is not resolved, its target is given in linkname.
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to an entry in the archive.
+ * @param out A destination for the metadata of the entry.
+ *
+ * @return zero if the entry was found,
+ *         -1 if no entry at the given path exists in the archive.
+ */
+int tar_stat(tar_index_t *index, const char *path, struct tar_stat *out);
+
+/**
+ * Rebuilds the full path of an entry (prefix included), as written in the archive but without repeated slashes.
+ *
+ * @param index An index built by tar_index_open().
+ * @param entry The entry field of a struct tar_stat filled with this index.
+ * @param path A destination for the path, TAR_PATH_MAX+1 bytes long.
+ *
+ * @return the length of the path.
+ */
+size_t tar_path(tar_index_t *index, uint32_t entry, char *path);
+
+/**
+ * Lists the entries at a given path in the archive with their metadata, like list().
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to a directory in the archive. If the entry is a symlink, it is resolved to its linked-to entry.
+ * @param entries An array of struct tar_stat.
+ * @param no_entries An in-out argument.
+ *                   The caller set it to the number of entries in `entries`.
+ *                   The callee set it to the number of entries listed.
+ *
+ * @return zero if no directory at the given path exists in the archive,
+ *         any other value otherwise.
+ */
+int tar_readdir_plus(tar_index_t *index, const char *path, struct tar_stat *entries, size_t *no_entries);
+
+/* Position in the listing of a directory, see tar_list_begin() */
+typedef struct {
+    tar_index_t *index;
+    size_t next;
+    size_t end;
+} tar_cursor_t;
+
+/**
+ * Starts listing the entries at a given path in the archive.
+ * The entries are given in the order of the archive, like list(), and the listing uses no memory besides the cursor.
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to a directory in the archive. If the entry is a symlink, it is resolved to its linked-to entry.
+ * @param cursor An out argument, the cursor to give to tar_list_next(). On failure, it lists no entries.
+ *
+ * @return -1 if no directory at the given path exists in the archive,
+ *         the total number of entries in the directory otherwise.
+ */
+ssize_t tar_list_begin(tar_index_t *index, const char *path, tar_cursor_t *cursor);
+
+/**
+ * Lists the next entries of a directory.
+ *
+ * @param cursor A cursor initialised by tar_list_begin().
+ * @param batch An array of max char arrays, each one is long enough to contain a tar entry path (TAR_PATH_MAX+1 bytes).
+ * @param max The size of batch.
+ *
+ * @return the number of entries written to batch, zero when all the entries have been listed.
+ */
+size_t tar_list_next(tar_cursor_t *cursor, char **batch, size_t max);
+
+/**
+ * Gets the digests of an entry computed when the index was built.
+ *
+ * @param index An index built by tar_index_open() with TAR_HASH_* flags.
+ * @param path A path to an entry in the archive.
+ * @param out A destination for the digests.
+ *
+ * @return zero if the entry was found,
+ *         -1 if no entry at the given path exists in the archive,
+ *         -2 if the index was built without digests.
+ */
+int tar_digest(tar_index_t *index, const char *path, struct tar_digest *out);
+
+/**
+ * Reads again the content of an entry and checks it against the digests of the index.
+ *
+ * @param index An index built by tar_index_open() with TAR_HASH_* flags.
+ * @param path A path to an entry in the archive.
+ *
+ * @return zero if the content matches the digests,
+ *         1 if the content does not match, or is cut short by the end of the archive,
+ *         -1 if no entry at the given path exists in the archive,
+ *         -2 if the index was built without digests,
+ *         -4 if there was a problem in a fonction
+ */
+int tar_verify(tar_index_t *index, const char *path);
+
 #endif
@@ -0,0 +1,322 @@
+#include "tar_hash.h"
+
+/*
+ * Empreintes du contenu des entrées, calculées au fil de la lecture : CRC32C (instruction crc32 de SSE4.2
+ * si le processeur l'a, sinon tables "slicing-by-8"), xxHash64 et SHA-256.
+ */
+
+/* ---------- CRC32C ---------- */
+
+#define CRC32C_POLY 0x82F63B78u   /* polynôme de Castagnoli, bits inversés */
+
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready = false;
+
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+        }
+    }
+    crc32c_table_ready = true;
+}
+
+static uint32_t crc32c_soft(uint32_t crc, const uint8_t *p, size_t len) {
+    if (!crc32c_table_ready) {
+        crc32c_init_table();
+    }
+    while (len >= 8) {//8 octets par tour, little-endian
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF]
+            ^ crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24]
+            ^ crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]]
+            ^ crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = crc64;
+    while (len--) {
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static uint32_t crc32c_update(uint32_t crc, const uint8_t *p, size_t len) {
+#if defined(__x86_64__)
+    static int has_sse42 = -1;
+    if (has_sse42 == -1) {
+        has_sse42 = __builtin_cpu_supports("sse4.2");
+    }
+    if (has_sse42) {
+        return crc32c_hw(crc, p, len);
+    }
+#endif
+    return crc32c_soft(crc, p, len);
+}
+
+/* ---------- xxHash64 ---------- */
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64_le(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline uint32_t read32_le(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+static void xxh64_update(tar_hash_t *hash, const uint8_t *p, size_t len) {
+    hash->xxh64.total_len += len;
+    uint64_t *v = hash->xxh64.v;
+    if (hash->xxh64.mem_len + len < 32) {
+        memcpy(hash->xxh64.mem + hash->xxh64.mem_len, p, len);
+        hash->xxh64.mem_len += len;
+        return;
+    }
+    if (hash->xxh64.mem_len > 0) {//on complète le bloc commencé
+        size_t fill = 32 - hash->xxh64.mem_len;
+        memcpy(hash->xxh64.mem + hash->xxh64.mem_len, p, fill);
+        for (int i = 0; i < 4; i++) {
+            v[i] = xxh64_round(v[i], read64_le(hash->xxh64.mem + 8 * i));
+        }
+        p += fill;
+        len -= fill;
+        hash->xxh64.mem_len = 0;
+    }
+    while (len >= 32) {
+        for (int i = 0; i < 4; i++) {
+            v[i] = xxh64_round(v[i], read64_le(p + 8 * i));
+        }
+        p += 32;
+        len -= 32;
+    }
+    memcpy(hash->xxh64.mem, p, len);
+    hash->xxh64.mem_len = len;
+}
+
+static uint64_t xxh64_final(const tar_hash_t *hash) {
+    const uint64_t *v = hash->xxh64.v;
+    uint64_t h;
+    if (hash->xxh64.total_len >= 32) {
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = xxh64_merge(h, v[i]);
+        }
+    } else {
+        h = v[2] + XXH_P5;//v[2] vaut la graine (0)
+    }
+    h += hash->xxh64.total_len;
+
+    const uint8_t *p = hash->xxh64.mem;
+    size_t len = hash->xxh64.mem_len;
+    while (len >= 8) {
+        h ^= xxh64_round(0, read64_le(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= read32_le(p) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        h ^= *p++ * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* ---------- SHA-256 ---------- */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static void sha256_block(uint32_t *h, const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
+}
+
+static void sha256_update(tar_hash_t *hash, const uint8_t *p, size_t len) {
+    hash->sha256.total_len += len;
+    if (hash->sha256.mem_len > 0) {
+        size_t fill = 64 - hash->sha256.mem_len < len ? 64 - hash->sha256.mem_len : len;
+        memcpy(hash->sha256.mem + hash->sha256.mem_len, p, fill);
+        hash->sha256.mem_len += fill;
+        p += fill;
+        len -= fill;
+        if (hash->sha256.mem_len < 64) {
+            return;
+        }
+        sha256_block(hash->sha256.h, hash->sha256.mem);
+        hash->sha256.mem_len = 0;
+    }
+    while (len >= 64) {
+        sha256_block(hash->sha256.h, p);
+        p += 64;
+        len -= 64;
+    }
+    memcpy(hash->sha256.mem, p, len);
+    hash->sha256.mem_len = len;
+}
+
+static void sha256_final(tar_hash_t *hash, uint8_t *out) {
+    uint64_t bits = hash->sha256.total_len * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t pad_len = (hash->sha256.mem_len < 56 ? 56 : 120) - hash->sha256.mem_len;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = bits >> (56 - 8 * i);
+    }
+    sha256_update(hash, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = hash->sha256.h[i] >> 24;
+        out[4 * i + 1] = hash->sha256.h[i] >> 16;
+        out[4 * i + 2] = hash->sha256.h[i] >> 8;
+        out[4 * i + 3] = hash->sha256.h[i];
+    }
+}
+
+/* ---------- interface ---------- */
+
+/**
+ * Starts the computation of the digests selected by flags (TAR_HASH_* values).
+ */
+void tar_hash_init(tar_hash_t *hash, int flags) {
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memset(hash, 0, sizeof(tar_hash_t));
+    hash->flags = flags;
+    hash->crc32c = 0xFFFFFFFFu;
+    hash->xxh64.v[0] = XXH_P1 + XXH_P2;//graine nulle
+    hash->xxh64.v[1] = XXH_P2;
+    hash->xxh64.v[2] = 0;
+    hash->xxh64.v[3] = -XXH_P1;
+    memcpy(hash->sha256.h, sha256_iv, sizeof(sha256_iv));
+}
+
+/**
+ * Adds len bytes of data to the digests.
+ */
+void tar_hash_update(tar_hash_t *hash, const void *data, size_t len) {
+    if (hash->flags & TAR_HASH_CRC32C) {
+        hash->crc32c = crc32c_update(hash->crc32c, data, len);
+    }
+    if (hash->flags & TAR_HASH_XXH64) {
+        xxh64_update(hash, data, len);
+    }
+    if (hash->flags & TAR_HASH_SHA256) {
+        sha256_update(hash, data, len);
+    }
+}
+
+/**
+ * Ends the computation, the digests not selected are set to zero in out.
+ */
+void tar_hash_final(tar_hash_t *hash, struct tar_digest *out) {
+    memset(out, 0, sizeof(struct tar_digest));
+    if (hash->flags & TAR_HASH_CRC32C) {
+        out->crc32c = ~hash->crc32c;
+    }
+    if (hash->flags & TAR_HASH_XXH64) {
+        out->xxh64 = xxh64_final(hash);
+    }
+    if (hash->flags & TAR_HASH_SHA256) {
+        sha256_final(hash, out->sha256);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef TAR_HASH_H
+#define TAR_HASH_H
+
+#include "lib_tar.h"
+
+/* Streaming state of the digests selected by TAR_HASH_* flags */
+typedef struct {
+    int flags;
+    uint32_t crc32c;
+    struct {
+        uint64_t v[4];
+        uint64_t total_len;
+        uint8_t mem[32];
+        size_t mem_len;
+    } xxh64;
+    struct {
+        uint32_t h[8];
+        uint64_t total_len;
+        uint8_t mem[64];
+        size_t mem_len;
+    } sha256;
+} tar_hash_t;
+
+/**
+ * Starts the computation of the digests selected by flags (TAR_HASH_* values).
+ */
+void tar_hash_init(tar_hash_t *hash, int flags);
+
+/**
+ * Adds len bytes of data to the digests.
+ */
+void tar_hash_update(tar_hash_t *hash, const void *data, size_t len);
+
+/**
+ * Ends the computation, the digests not selected are set to zero in out.
+ */
+void tar_hash_final(tar_hash_t *hash, struct tar_digest *out);
+
+#endif
@@ -0,0 +1,1202 @@
+#define _GNU_SOURCE /* O_DIRECT, F_ADD_SEALS */
+#include <sys/mman.h>
+
+#include "tar_hash.h"
+
+/*
+ * Index d'une archive : une seule lecture séquentielle de l'archive remplit une table de métadonnées
+ * rangée par colonnes (un tableau par champ), pour que les parcours en masse ne touchent que les champs utiles.
+ * Les chemins ne sont pas stockés en entier : chaque composant est stocké une fois, et un chemin est un nœud
+ * d'un arbre dont les arêtes sont des composants, si bien qu'une recherche coûte un accès par niveau.
+ */
+
+#define NONE UINT32_MAX           /* pas d'entrée (par ex. pas de répertoire parent) */
+#define SHADOWED (UINT32_MAX - 1) /* parent d'une entrée remplacée par une entrée plus loin dans l'archive */
+#define SCAN_BUF (64 * 1024)      /* taille du tampon de lecture du scanner */
+#define IO_ALIGN 4096             /* alignement des lectures avec O_DIRECT */
+#define DROP_CHUNK (8 << 20)      /* TAR_IO_DONTNEED : on libère le cache par tranches de cette taille... */
+#define DROP_OVERLAP (2 << 20)    /* ...en reprenant la fin de la tranche d'avant, dont les grandes folios débordaient */
+#define HASH_FLAGS (TAR_HASH_CRC32C | TAR_HASH_XXH64 | TAR_HASH_SHA256)
+
+struct tar_index {
+    int tar_fd;
+    int io_fd;                    /* descripteur utilisé pour les lectures, ouvert avec O_DIRECT si TAR_IO_DIRECT */
+    int flags;
+    size_t count;
+    size_t capacity;
+    /* une colonne par champ, la ligne i décrit la i-ème entrée retenue */
+    uint64_t *offset;             /* offset du contenu dans l'archive */
+    uint64_t *size;
+    int64_t *mtime;
+    uint32_t *mode;
+    uint32_t *uid;
+    uint32_t *gid;
+    char *typeflag;
+    uint8_t *slash;               /* 1 si le chemin de l'entrée finit par un / */
+    uint32_t *node;               /* nœud du chemin dans l'arbre des noms, NONE pour un nom vide */
+    uint32_t *linkname;           /* offset de la cible dans strings */
+    uint32_t *parent;             /* ligne du répertoire parent, NONE à la racine, SHADOWED si remplacée */
+    struct tar_digest *digest;    /* empreintes du contenu, NULL sans TAR_HASH_* */
+    /* enfants de chaque répertoire dans l'ordre de l'archive : ceux de la ligne i sont
+     * children[first_child[i]] à children[first_child[i + 1] - 1] */
+    uint32_t *first_child;
+    uint32_t *children;
+    /* arbre des noms : un nœud par chemin, désigné par (nœud parent, composant), les préfixes communs sont partagés */
+    size_t nb_nodes;
+    size_t nodes_cap;
+    uint32_t *node_parent;        /* NONE au premier niveau */
+    uint32_t *node_comp;
+    uint32_t *node_row;           /* dernière entrée avec ce chemin, NONE pour un répertoire implicite */
+    /* composants des chemins, chacun stocké une seule fois avec son hachage */
+    size_t nb_comps;
+    size_t comps_cap;
+    uint32_t *comp_name;          /* offset du composant dans strings */
+    uint32_t *comp_hash;
+    /* tables de hachage composant -> identifiant+1 et (parent, composant) -> nœud+1 (0 = case vide), adressage ouvert */
+    uint32_t *comp_buckets;
+    size_t nb_comp_buckets;
+    uint32_t *node_buckets;
+    size_t nb_node_buckets;
+    /* chaînes terminées par un null, mises bout à bout */
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+    /* index attaché par tar_index_attach() : les colonnes pointent dans cette région en lecture seule */
+    void *map;
+    size_t map_len;
+};
+
+typedef struct {
+    int fd;
+    int flags;                    /* TAR_IO_* */
+    uint8_t *buf;                 /* aligné sur IO_ALIGN pour O_DIRECT */
+    size_t len;                   /* nombre d'octets valides dans buf */
+    size_t pos;                   /* position de lecture dans buf */
+    uint64_t off;                 /* offset dans l'archive de buf[0] */
+    uint64_t origin;              /* premier offset lu, on ne libère rien avant */
+    uint64_t dropped;             /* avec TAR_IO_DONTNEED, le cache est libéré avant cet offset */
+} scanner_t;
+
+static int scan_open(scanner_t *s, int fd, int flags, uint64_t off) {
+    memset(s, 0, sizeof(scanner_t));
+    s->fd = fd;
+    s->flags = flags & (TAR_IO_DIRECT | TAR_IO_DONTNEED);
+    s->off = off;
+    s->origin = off & ~(uint64_t) (IO_ALIGN - 1);
+    s->dropped = s->origin;
+    void *buf;
+    if (posix_memalign(&buf, IO_ALIGN, SCAN_BUF) != 0) {
+        return -4;
+    }
+    s->buf = buf;
+    return 0;
+}
+
+/*
+ * Libère le cache des pages de l'archive avant l'offset end (seulement avec TAR_IO_DONTNEED).
+ * Le noyau garde une folio qui dépasse de l'intervalle, d'où les tranches qui se chevauchent.
+ */
+static void scan_drop(scanner_t *s, uint64_t end, bool force) {
+    if (!(s->flags & TAR_IO_DONTNEED) || end <= s->dropped || (!force && end - s->dropped < DROP_CHUNK)) {
+        return;
+    }
+    uint64_t start = s->dropped > s->origin + DROP_OVERLAP ? s->dropped - DROP_OVERLAP : s->origin;
+    posix_fadvise(s->fd, start, end - start, POSIX_FADV_DONTNEED);
+    s->dropped = end;
+}
+
+static void scan_close(scanner_t *s) {
+    scan_drop(s, s->off + s->len, true);
+    free(s->buf);
+}
+
+/*
+ * Recharge le tampon à partir de la position courante, retourne le nombre d'octets disponibles ou -1.
+ * Avec TAR_IO_DIRECT, la lecture commence à l'offset aligné qui précède la position courante : si le fichier
+ * s'arrête entre les deux, pos dépasse len, et les appelants doivent tester len <= pos avant len - pos.
+ */
+static ssize_t scan_fill(scanner_t *s) {
+    uint64_t start = s->off + s->pos;
+    uint64_t base = start;
+    if (s->flags & TAR_IO_DIRECT) {
+        base &= ~(uint64_t) (IO_ALIGN - 1);
+    }
+    scan_drop(s, base, false);//on ne repassera pas derrière le curseur
+    s->off = base;
+    s->pos = start - base;
+    s->len = 0;
+    while (s->len < SCAN_BUF) {
+        ssize_t rd = pread(s->fd, s->buf + s->len, SCAN_BUF - s->len, s->off + s->len);
+        if (rd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (rd == 0) {
+            break;
+        }
+        s->len += rd;
+        if ((s->flags & TAR_IO_DIRECT) && s->len % IO_ALIGN != 0) {//fin du fichier, la suite ne serait plus alignée
+            break;
+        }
+    }
+    return s->len > s->pos ? s->len - s->pos : 0;
+}
+
+/* Donne le prochain bloc de 512 octets, ou NULL et *err vaut -4 si read a échoué, -5 à la fin du fichier. */
+static const uint8_t *scan_block(scanner_t *s, int *err) {
+    if (s->len <= s->pos || s->len - s->pos < 512) {
+        if (scan_fill(s) == -1) {
+            *err = -4;
+            return NULL;
+        }
+        if (s->len <= s->pos || s->len - s->pos < 512) {//archive tronquée : fin du fichier avant les deux blocs vides, comme check_archive
+            *err = -5;
+            return NULL;
+        }
+    }
+    const uint8_t *block = s->buf + s->pos;
+    s->pos += 512;
+    return block;
+}
+
+/* Saute n octets de contenu, sans les lire s'ils ne sont pas déjà dans le tampon. */
+static void scan_skip(scanner_t *s, uint64_t n) {
+    if (s->pos <= s->len && n <= s->len - s->pos) {
+        s->pos += n;
+        return;
+    }
+    s->off += s->pos + n;
+    s->pos = 0;
+    s->len = 0;
+}
+
+/* Lit n octets de contenu et les passe aux fonctions de hachage, -5 si l'archive s'arrête avant. */
+static int scan_hash(scanner_t *s, uint64_t n, tar_hash_t *hash) {
+    while (n > 0) {
+        if (s->len <= s->pos) {
+            if (scan_fill(s) == -1) {
+                return -4;
+            }
+            if (s->len <= s->pos) {//archive tronquée : un contenu incomplet n'a pas d'empreinte
+                return -5;
+            }
+        }
+        size_t chunk = s->len - s->pos < n ? s->len - s->pos : n;
+        tar_hash_update(hash, s->buf + s->pos, chunk);
+        s->pos += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+static uint64_t scan_tell(const scanner_t *s) {
+    return s->off + s->pos;
+}
+
+static bool is_zero_block(const uint8_t *block) {
+    for (int i = 0; i < 512; i++) {
+        if (block[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* FNV-1a sur les n premiers octets de str */
+static uint32_t hash_str(const char *str, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Hachage de la clé (nœud parent, composant) d'un nœud de l'arbre des noms */
+static uint32_t hash_node(uint32_t parent, uint32_t comp) {
+    return (((uint64_t) parent << 32 | comp) * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+static uint32_t comp_hash_of(const tar_index_t *index, uint32_t comp) {
+    return index->comp_hash[comp];
+}
+
+static uint32_t node_hash_of(const tar_index_t *index, uint32_t node) {
+    return hash_node(index->node_parent[node], index->node_comp[node]);
+}
+
+/* Ajoute une chaîne de n octets (plus un null) à strings, retourne son offset ou NONE. */
+static uint32_t add_string(tar_index_t *index, const char *str, size_t n) {
+    if (index->strings_len + n + 1 > index->strings_cap) {
+        size_t cap = index->strings_cap ? index->strings_cap : 4096;
+        while (index->strings_len + n + 1 > cap) {
+            cap *= 2;
+        }
+        if (cap > NONE) {
+            return NONE;
+        }
+        char *strings = realloc(index->strings, cap);
+        if (strings == NULL) {
+            return NONE;
+        }
+        index->strings = strings;
+        index->strings_cap = cap;
+    }
+    uint32_t off = index->strings_len;
+    memcpy(index->strings + off, str, n);
+    index->strings[off + n] = '\0';
+    index->strings_len += n + 1;
+    return off;
+}
+
+#define GROW(field) do { \
+        void *p = realloc(index->field, cap * sizeof(*index->field)); \
+        if (p == NULL) { return -4; } \
+        index->field = p; \
+    } while (0)
+
+/* Agrandit les colonnes des lignes, à la taille exacte si fit (en fin de construction). */
+static int grow_rows(tar_index_t *index, bool fit) {
+    size_t cap = index->capacity ? index->capacity * 2 : 1024;
+    if (fit) {
+        cap = index->count ? index->count : 1;
+    }
+    GROW(offset);
+    GROW(size);
+    GROW(mtime);
+    GROW(mode);
+    GROW(uid);
+    GROW(gid);
+    GROW(typeflag);
+    GROW(slash);
+    GROW(node);
+    GROW(linkname);
+    GROW(parent);
+    if (index->flags & HASH_FLAGS) {
+        GROW(digest);
+    }
+    index->capacity = cap;
+    return 0;
+}
+
+static int grow_comps(tar_index_t *index, bool fit) {
+    size_t cap = index->comps_cap ? index->comps_cap * 2 : 1024;
+    if (fit) {
+        cap = index->nb_comps ? index->nb_comps : 1;
+    }
+    GROW(comp_name);
+    GROW(comp_hash);
+    index->comps_cap = cap;
+    return 0;
+}
+
+static int grow_nodes(tar_index_t *index, bool fit) {
+    size_t cap = index->nodes_cap ? index->nodes_cap * 2 : 1024;
+    if (fit) {
+        cap = index->nb_nodes ? index->nb_nodes : 1;
+    }
+    GROW(node_parent);
+    GROW(node_comp);
+    GROW(node_row);
+    index->nodes_cap = cap;
+    return 0;
+}
+
+#undef GROW
+
+/*
+ * Double la taille d'une table de hachage identifiant+1 (0 = case vide) et y replace les nb premiers identifiants,
+ * dont hash_of donne le hachage.
+ */
+static int rehash(const tar_index_t *index, uint32_t **buckets, size_t *nb_buckets, size_t nb,
+                  uint32_t (*hash_of)(const tar_index_t *, uint32_t)) {
+    size_t size = *nb_buckets ? *nb_buckets * 2 : 1024;
+    uint32_t *table = calloc(size, sizeof(uint32_t));
+    if (table == NULL) {
+        return -4;
+    }
+    size_t mask = size - 1;
+    for (uint32_t id = 0; id < nb; id++) {
+        size_t b = hash_of(index, id) & mask;
+        while (table[b] != 0) {
+            b = (b + 1) & mask;
+        }
+        table[b] = id + 1;
+    }
+    free(*buckets);
+    *buckets = table;
+    *nb_buckets = size;
+    return 0;
+}
+
+/* Range l'identifiant id de hachage h dans une table qui a de la place. */
+static void insert_id(uint32_t *buckets, size_t nb_buckets, uint32_t h, uint32_t id) {
+    size_t mask = nb_buckets - 1;
+    size_t b = h & mask;
+    while (buckets[b] != 0) {
+        b = (b + 1) & mask;
+    }
+    buckets[b] = id + 1;
+}
+
+/* Cherche le composant de n octets et de hachage h, NONE s'il n'a jamais été vu. */
+static uint32_t find_comp(const tar_index_t *index, const char *comp, size_t n, uint32_t h) {
+    if (index->nb_comp_buckets == 0) {
+        return NONE;
+    }
+    size_t mask = index->nb_comp_buckets - 1;
+    for (size_t b = h & mask; index->comp_buckets[b] != 0; b = (b + 1) & mask) {
+        uint32_t id = index->comp_buckets[b] - 1;
+        if (index->comp_hash[id] != h) {//le hachage précalculé évite presque toutes les comparaisons de chaînes
+            continue;
+        }
+        const char *name = index->strings + index->comp_name[id];
+        if (strncmp(name, comp, n) == 0 && name[n] == '\0') {
+            return id;
+        }
+    }
+    return NONE;
+}
+
+/* Cherche le nœud de composant comp sous le nœud parent (NONE pour la racine), NONE s'il n'existe pas. */
+static uint32_t find_node(const tar_index_t *index, uint32_t parent, uint32_t comp) {
+    if (index->nb_node_buckets == 0) {
+        return NONE;
+    }
+    size_t mask = index->nb_node_buckets - 1;
+    for (size_t b = hash_node(parent, comp) & mask; index->node_buckets[b] != 0; b = (b + 1) & mask) {
+        uint32_t node = index->node_buckets[b] - 1;
+        if (index->node_parent[node] == parent && index->node_comp[node] == comp) {
+            return node;
+        }
+    }
+    return NONE;
+}
+
+/* Identifiant du composant de n octets, ajouté s'il est nouveau, NONE en cas d'erreur. */
+static uint32_t intern_comp(tar_index_t *index, const char *comp, size_t n) {
+    uint32_t h = hash_str(comp, n);
+    uint32_t id = find_comp(index, comp, n, h);
+    if (id != NONE) {
+        return id;
+    }
+    if (index->nb_comps == index->comps_cap && grow_comps(index, false) != 0) {
+        return NONE;
+    }
+    if (2 * (index->nb_comps + 1) > index->nb_comp_buckets
+        && rehash(index, &index->comp_buckets, &index->nb_comp_buckets, index->nb_comps, comp_hash_of) != 0) {
+        return NONE;
+    }
+    uint32_t name = add_string(index, comp, n);
+    if (name == NONE) {
+        return NONE;
+    }
+    id = index->nb_comps++;
+    index->comp_name[id] = name;
+    index->comp_hash[id] = h;
+    insert_id(index->comp_buckets, index->nb_comp_buckets, h, id);
+    return id;
+}
+
+/* Nœud de composant comp sous le nœud parent, ajouté s'il est nouveau, NONE en cas d'erreur. */
+static uint32_t intern_node(tar_index_t *index, uint32_t parent, uint32_t comp) {
+    uint32_t node = find_node(index, parent, comp);
+    if (node != NONE) {
+        return node;
+    }
+    if (index->nb_nodes == index->nodes_cap && grow_nodes(index, false) != 0) {
+        return NONE;
+    }
+    if (2 * (index->nb_nodes + 1) > index->nb_node_buckets
+        && rehash(index, &index->node_buckets, &index->nb_node_buckets, index->nb_nodes, node_hash_of) != 0) {
+        return NONE;
+    }
+    node = index->nb_nodes++;
+    index->node_parent[node] = parent;
+    index->node_comp[node] = comp;
+    index->node_row[node] = NONE;//répertoire implicite tant qu'aucune entrée n'a ce chemin
+    insert_id(index->node_buckets, index->nb_node_buckets, hash_node(parent, comp), node);
+    return node;
+}
+
+/*
+ * Composant suivant de path (n octets) à partir de *pos, les / répétés sont sautés. NULL à la fin du chemin.
+ * Un / au début donne un premier composant vide : /a et a sont deux chemins différents, comme pour list(),
+ * et tar_path() retrouve le / en joignant les composants.
+ */
+static const char *next_comp(const char *path, size_t n, size_t *pos, size_t *comp_len) {
+    size_t i = *pos;
+    if (i == 0 && n > 0 && path[0] == '/') {
+        *pos = 1;
+        *comp_len = 0;
+        return path;
+    }
+    while (i < n && path[i] == '/') {
+        i++;
+    }
+    if (i == n) {
+        return NULL;
+    }
+    size_t start = i;
+    while (i < n && path[i] != '/') {
+        i++;
+    }
+    *pos = i;
+    *comp_len = i - start;
+    return path + start;
+}
+
+/*
+ * Cherche la ligne d'un chemin de n octets, NONE s'il n'est pas dans l'index.
+ * Une recherche par composant : le coût dépend de la profondeur du chemin, pas du nombre d'entrées
+ * ni de la longueur des préfixes communs. Un / final n'est accepté que pour un répertoire ou un lien.
+ */
+static uint32_t find_path(const tar_index_t *index, const char *path, size_t n) {
+    uint32_t node = NONE;
+    size_t pos = 0;
+    size_t comp_len;
+    const char *comp;
+    while ((comp = next_comp(path, n, &pos, &comp_len)) != NULL) {
+        uint32_t id = find_comp(index, comp, comp_len, hash_str(comp, comp_len));
+        if (id == NONE) {
+            return NONE;
+        }
+        node = find_node(index, node, id);
+        if (node == NONE) {
+            return NONE;
+        }
+    }
+    if (node == NONE) {
+        return NONE;
+    }
+    uint32_t row = index->node_row[node];
+    if (row != NONE && path[n - 1] == '/' && index->typeflag[row] != DIRTYPE && index->typeflag[row] != SYMTYPE) {
+        return NONE;
+    }
+    return row;
+}
+
+/*
+ * Le parent d'une entrée est le répertoire le plus proche qui la contient dans l'archive,
+ * comme pour list() quand les répertoires intermédiaires manquent.
+ */
+static void link_parents(tar_index_t *index) {
+    for (size_t row = 0; row < index->count; row++) {
+        if (index->parent[row] == SHADOWED || index->node[row] == NONE) {
+            continue;
+        }
+        uint32_t parent = NONE;
+        for (uint32_t p = index->node_parent[index->node[row]]; p != NONE; p = index->node_parent[p]) {
+            uint32_t dir = index->node_row[p];
+            if (dir != NONE && index->typeflag[dir] == DIRTYPE) {
+                parent = dir;
+                break;
+            }
+        }
+        index->parent[row] = parent;
+    }
+}
+
+/* Range les enfants de chaque répertoire à la suite (tri par comptage sur la colonne parent). */
+static int build_children(tar_index_t *index) {
+    index->first_child = calloc(index->count + 1, sizeof(uint32_t));
+    index->children = malloc((index->count ? index->count : 1) * sizeof(uint32_t));
+    if (index->first_child == NULL || index->children == NULL) {
+        return -4;
+    }
+    for (size_t row = 0; row < index->count; row++) {
+        uint32_t parent = index->parent[row];
+        if (parent != NONE && parent != SHADOWED) {
+            index->first_child[parent + 1]++;
+        }
+    }
+    for (size_t row = 0; row < index->count; row++) {
+        index->first_child[row + 1] += index->first_child[row];
+    }
+    uint32_t *next = malloc((index->count ? index->count : 1) * sizeof(uint32_t));
+    if (next == NULL) {
+        return -4;
+    }
+    memcpy(next, index->first_child, index->count * sizeof(uint32_t));
+    for (size_t row = 0; row < index->count; row++) {//parcours dans l'ordre : chaque liste reste dans l'ordre de l'archive
+        uint32_t parent = index->parent[row];
+        if (parent != NONE && parent != SHADOWED) {
+            index->children[next[parent]++] = row;
+        }
+    }
+    free(next);
+    return 0;
+}
+
+/* Ajoute la ligne décrite par header, dont le contenu commence à offset. */
+static int add_row(tar_index_t *index, const tar_header_t *header, uint64_t offset) {
+    if (index->count == index->capacity && grow_rows(index, false) != 0) {
+        return -4;
+    }
+    char path[TAR_PATH_MAX];
+    size_t n = 0;
+    size_t prefix_len = strnlen(header->prefix, sizeof(header->prefix));
+    if (prefix_len > 0) {//format ustar : le chemin complet est prefix/name
+        memcpy(path, header->prefix, prefix_len);
+        path[prefix_len] = '/';
+        n = prefix_len + 1;
+    }
+    size_t name_len = strnlen(header->name, sizeof(header->name));
+    memcpy(path + n, header->name, name_len);
+    n += name_len;
+
+    size_t row = index->count;
+    uint32_t node = NONE;//un nom vide n'a pas de nœud, on ne peut pas le chercher
+    size_t pos = 0;
+    size_t comp_len;
+    const char *comp;
+    while ((comp = next_comp(path, n, &pos, &comp_len)) != NULL) {
+        uint32_t id = intern_comp(index, comp, comp_len);
+        node = id == NONE ? NONE : intern_node(index, node, id);
+        if (node == NONE) {
+            return -4;
+        }
+    }
+    if (node != NONE) {
+        if (index->node_row[node] != NONE) {//la dernière entrée d'un chemin remplace les autres
+            index->parent[index->node_row[node]] = SHADOWED;
+        }
+        index->node_row[node] = row;
+    }
+    index->node[row] = node;
+    index->slash[row] = n > 0 && path[n - 1] == '/';
+    size_t link_len = strnlen(header->linkname, sizeof(header->linkname));
+    index->linkname[row] = link_len == 0 ? 0 : add_string(index, header->linkname, link_len);//strings[0] est ""
+    if (index->linkname[row] == NONE) {
+        return -4;
+    }
+    index->offset[row] = offset;
+    index->size[row] = TAR_INT(header->size);
+    index->mtime[row] = TAR_INT(header->mtime);
+    index->mode[row] = TAR_INT(header->mode);
+    index->uid[row] = TAR_INT(header->uid);
+    index->gid[row] = TAR_INT(header->gid);
+    index->typeflag[row] = header->typeflag == AREGTYPE ? REGTYPE : header->typeflag;
+    index->parent[row] = NONE;
+    index->count++;
+    return 0;
+}
+
+/*
+ * Avec TAR_IO_DIRECT, rouvre l'archive avec O_DIRECT sans toucher au descripteur de l'appelant.
+ * Si le système de fichiers ne le permet pas, on se rabat sur TAR_IO_DONTNEED.
+ */
+static void open_direct(tar_index_t *index) {
+    if (!(index->flags & TAR_IO_DIRECT)) {
+        return;
+    }
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", index->tar_fd);
+    int fd = open(proc_path, O_RDONLY | O_DIRECT);
+    if (fd == -1) {
+        index->flags = (index->flags & ~TAR_IO_DIRECT) | TAR_IO_DONTNEED;
+        return;
+    }
+    index->io_fd = fd;
+}
+
+/**
+ * Builds the index of an archive by scanning it once.
+ *
+ * @param tar_fd A file descriptor pointing to a tar archive file. It must stay open until tar_index_close().
+ * @param flags A combination of TAR_HASH_* and TAR_IO_* values, or zero.
+ * @param index An out argument, set to the new index on success.
+ *
+ * @return a zero or positive value on success, representing the number of entries in the index,
+ *         -1 if the archive contains a header with an invalid magic value,
+ *         -2 if the archive contains a header with an invalid version value,
+ *         -3 if the archive contains a header with an invalid checksum value
+ *         -4 if there was a problem in a fonction
+ *         -5 if the archive is truncated (it ends before the two zero blocks or inside the content of an entry)
+ *            or contains a header with an invalid size
+ */
+int tar_index_open(int tar_fd, int flags, tar_index_t **index) {
+    tar_index_t *idx = calloc(1, sizeof(tar_index_t));
+    if (idx == NULL) {
+        return -4;
+    }
+    idx->tar_fd = tar_fd;
+    idx->io_fd = tar_fd;
+    idx->flags = flags;
+    open_direct(idx);
+    struct stat st;
+    scanner_t s;
+    if (add_string(idx, "", 0) != 0) {//offset 0 : la chaîne vide, partagée par toutes les entrées sans cible
+        tar_index_close(idx);
+        return -4;
+    }
+    if (fstat(tar_fd, &st) == -1 || scan_open(&s, idx->io_fd, idx->flags, 0) != 0) {
+        tar_index_close(idx);
+        return -4;
+    }
+
+    int ret = 0;
+    int nb_zero = 0;
+    while (nb_zero < 2) {
+        const uint8_t *block = scan_block(&s, &ret);
+        if (block == NULL) {
+            break;
+        }
+        if (is_zero_block(block)) {
+            nb_zero++;
+            continue;
+        }
+        nb_zero = 0;
+        const tar_header_t *header = (const tar_header_t *) block;
+        ret = tar_check_header(header);
+        if (ret != 0) {
+            break;
+        }
+        int64_t size = TAR_INT(header->size);
+        if (size < 0 || (uint64_t) size > st.st_size - scan_tell(&s)) {//taille corrompue ou contenu hors du fichier
+            ret = -5;
+            break;
+        }
+        ret = add_row(idx, header, scan_tell(&s));
+        if (ret != 0) {
+            break;
+        }
+        if (flags & HASH_FLAGS) {//on hache le contenu pendant qu'il passe, puis on saute le bourrage
+            tar_hash_t hash;
+            tar_hash_init(&hash, flags);
+            ret = scan_hash(&s, size, &hash);
+            if (ret != 0) {
+                break;
+            }
+            tar_hash_final(&hash, &idx->digest[idx->count - 1]);
+            scan_skip(&s, (size + 511) / 512 * 512 - size);
+        } else {
+            scan_skip(&s, (size + 511) / 512 * 512);
+        }
+    }
+    bool direct_refused = ret == -4 && (idx->flags & TAR_IO_DIRECT) && errno == EINVAL;
+    scan_close(&s);
+    if (ret != 0) {
+        tar_index_close(idx);
+        if (direct_refused) {//O_DIRECT accepté par open() mais pas par pread() : même repli que dans open_direct()
+            return tar_index_open(tar_fd, (flags & ~TAR_IO_DIRECT) | TAR_IO_DONTNEED, index);
+        }
+        return ret;
+    }
+    link_parents(idx);
+    char *strings = realloc(idx->strings, idx->strings_len);//la construction est finie, on rend la marge des tableaux
+    if (strings != NULL) {
+        idx->strings = strings;
+        idx->strings_cap = idx->strings_len;
+    }
+    if (grow_rows(idx, true) != 0 || grow_comps(idx, true) != 0 || grow_nodes(idx, true) != 0
+        || build_children(idx) != 0) {
+        tar_index_close(idx);
+        return -4;
+    }
+    *index = idx;
+    return idx->count;
+}
+
+/**
+ * Frees an index built by tar_index_open().
+ */
+void tar_index_close(tar_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+    if (index->io_fd != index->tar_fd) {
+        close(index->io_fd);
+    }
+    if (index->map != NULL) {//les colonnes appartiennent à la région partagée
+        munmap(index->map, index->map_len);
+        free(index);
+        return;
+    }
+    free(index->offset);
+    free(index->size);
+    free(index->mtime);
+    free(index->mode);
+    free(index->uid);
+    free(index->gid);
+    free(index->typeflag);
+    free(index->slash);
+    free(index->node);
+    free(index->linkname);
+    free(index->parent);
+    free(index->digest);
+    free(index->first_child);
+    free(index->children);
+    free(index->node_parent);
+    free(index->node_comp);
+    free(index->node_row);
+    free(index->comp_name);
+    free(index->comp_hash);
+    free(index->comp_buckets);
+    free(index->node_buckets);
+    free(index->strings);
+    free(index);
+}
+
+/**
+ * Gets the memory used by an index, in bytes.
+ * For an index attached with tar_index_attach(), this is the shared region, counted once for all the processes.
+ */
+size_t tar_index_size(const tar_index_t *index) {
+    if (index->map != NULL) {
+        return sizeof(tar_index_t) + index->map_len;
+    }
+    size_t row = sizeof(*index->offset) + sizeof(*index->size) + sizeof(*index->mtime) + sizeof(*index->mode)
+                 + sizeof(*index->uid) + sizeof(*index->gid) + sizeof(*index->typeflag) + sizeof(*index->slash)
+                 + sizeof(*index->node) + sizeof(*index->linkname) + sizeof(*index->parent);
+    if (index->flags & HASH_FLAGS) {
+        row += sizeof(*index->digest);
+    }
+    size_t children = index->first_child ? (2 * index->count + 1) * sizeof(uint32_t) : 0;
+    return sizeof(tar_index_t) + index->capacity * row + children
+           + index->nodes_cap * (sizeof(*index->node_parent) + sizeof(*index->node_comp) + sizeof(*index->node_row))
+           + index->comps_cap * (sizeof(*index->comp_name) + sizeof(*index->comp_hash))
+           + (index->nb_comp_buckets + index->nb_node_buckets) * sizeof(uint32_t) + index->strings_cap;
+}
+
+/*
+ * Index partagé (tar_index_export() et tar_index_attach()) : les colonnes sont rangées l'une après l'autre dans une
+ * même région, derrière un en-tête qui donne leur offset. Elles ne contiennent que des numéros de ligne ou de nœud
+ * et des offsets dans strings, jamais de pointeurs, la région est donc valable à n'importe quelle adresse.
+ */
+
+#define SHARED_MAGIC "TARIDX1"    /* avec le null, 8 octets, à changer si la disposition de la région change */
+#define SHARED_ALIGN 64           /* chaque colonne commence sur une ligne de cache */
+
+/* X(colonne, nombre d'éléments) pour chaque colonne de la région, dans l'ordre de la région */
+#define SHARED_COLUMNS(X) \
+    X(offset, index->count) \
+    X(size, index->count) \
+    X(mtime, index->count) \
+    X(mode, index->count) \
+    X(uid, index->count) \
+    X(gid, index->count) \
+    X(typeflag, index->count) \
+    X(slash, index->count) \
+    X(node, index->count) \
+    X(linkname, index->count) \
+    X(parent, index->count) \
+    X(digest, index->flags & HASH_FLAGS ? index->count : 0) \
+    X(first_child, index->count + 1) \
+    X(children, index->count) \
+    X(node_parent, index->nb_nodes) \
+    X(node_comp, index->nb_nodes) \
+    X(node_row, index->nb_nodes) \
+    X(comp_name, index->nb_comps) \
+    X(comp_hash, index->nb_comps) \
+    X(comp_buckets, index->nb_comp_buckets) \
+    X(node_buckets, index->nb_node_buckets) \
+    X(strings, index->strings_len)
+
+typedef struct {
+    char magic[8];
+    uint64_t flags;
+    uint64_t count;
+    uint64_t nb_nodes;
+    uint64_t nb_comps;
+    uint64_t nb_comp_buckets;
+    uint64_t nb_node_buckets;
+    uint64_t strings_len;
+    /* archive indexée, pour refuser la région avec une autre archive ou une archive modifiée depuis */
+    uint64_t archive_dev;
+    uint64_t archive_ino;
+    uint64_t archive_size;
+    int64_t archive_mtime;        /* en nanosecondes */
+    uint64_t total_size;          /* taille de la région */
+#define COLUMN_OFFSET(field, n) uint64_t field;
+    SHARED_COLUMNS(COLUMN_OFFSET)
+#undef COLUMN_OFFSET
+} shared_header_t;
+
+static uint64_t shared_align(uint64_t n) {
+    return (n + SHARED_ALIGN - 1) / SHARED_ALIGN * SHARED_ALIGN;
+}
+
+static void archive_identity(const struct stat *st, shared_header_t *header) {
+    header->archive_dev = st->st_dev;
+    header->archive_ino = st->st_ino;
+    header->archive_size = st->st_size;
+    header->archive_mtime = (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* pwrite() de len octets en entier, -1 en cas d'erreur */
+static int write_at(int fd, const void *buf, size_t len, uint64_t off) {
+    const uint8_t *bytes = buf;
+    while (len > 0) {
+        ssize_t wr = pwrite(fd, bytes, len, off);
+        if (wr == -1 && errno == EINTR) {
+            continue;
+        }
+        if (wr <= 0) {
+            return -1;
+        }
+        bytes += wr;
+        len -= wr;
+        off += wr;
+    }
+    return 0;
+}
+
+/**
+ * Copies an index into a shared memory region, see tar_index_attach().
+ *
+ * @param index An index built by tar_index_open().
+ * @param shm_fd A file descriptor open for writing, from memfd_create() or on a regular file.
+ *
+ * @return zero on success,
+ *         -4 if there was a problem in a fonction
+ */
+int tar_index_export(tar_index_t *index, int shm_fd) {
+    struct stat st;
+    if (fstat(index->tar_fd, &st) == -1) {
+        return -4;
+    }
+    shared_header_t header;
+    memset(&header, 0, sizeof(shared_header_t));
+    header.flags = index->flags;
+    header.count = index->count;
+    header.nb_nodes = index->nb_nodes;
+    header.nb_comps = index->nb_comps;
+    header.nb_comp_buckets = index->nb_comp_buckets;
+    header.nb_node_buckets = index->nb_node_buckets;
+    header.strings_len = index->strings_len;
+    archive_identity(&st, &header);
+    uint64_t off = shared_align(sizeof(shared_header_t));
+#define LAYOUT(field, n) \
+    header.field = off; \
+    off += shared_align((uint64_t) (n) * sizeof(*index->field));
+    SHARED_COLUMNS(LAYOUT)
+#undef LAYOUT
+    header.total_size = off;
+    //une région déjà exportée garde son en-tête pendant qu'on réécrit les colonnes : on l'invalide avant tout
+    shared_header_t empty;
+    memset(&empty, 0, sizeof(shared_header_t));
+    if (write_at(shm_fd, &empty, sizeof(shared_header_t), 0) != 0 || ftruncate(shm_fd, off) == -1) {
+        return -4;
+    }
+#define WRITE_COLUMN(field, n) \
+    if (write_at(shm_fd, index->field, (n) * sizeof(*index->field), header.field) != 0) { \
+        return -4; \
+    }
+    SHARED_COLUMNS(WRITE_COLUMN)
+#undef WRITE_COLUMN
+    //l'en-tête après les colonnes, et le magic en tout dernier : la région n'est valide que complète
+    if (write_at(shm_fd, &header, sizeof(shared_header_t), 0) != 0
+        || write_at(shm_fd, SHARED_MAGIC, sizeof(header.magic), 0) != 0) {
+        return -4;
+    }
+    //une memfd créée avec MFD_ALLOW_SEALING devient immuable, un lecteur ne peut pas la voir rétrécir sous lui
+    fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    return 0;
+}
+
+/* Vrai si une colonne de n éléments de elem_size octets à l'offset off tient dans la région */
+static bool column_fits(uint64_t off, uint64_t n, size_t elem_size, uint64_t total_size) {
+    return off % SHARED_ALIGN == 0 && off <= total_size && n <= (total_size - off) / elem_size;
+}
+
+/* Fait pointer les colonnes de index dans la région map, -6 si l'en-tête ne décrit pas une région cohérente. */
+static int map_columns(tar_index_t *index, const shared_header_t *header) {
+    if (header->count >= SHADOWED || header->nb_nodes >= NONE || header->nb_comps >= NONE
+        || header->nb_comp_buckets >= NONE || header->nb_node_buckets >= NONE || header->strings_len >= NONE) {
+        return -6;
+    }
+    index->flags = header->flags;
+    index->count = index->capacity = header->count;
+    index->nb_nodes = index->nodes_cap = header->nb_nodes;
+    index->nb_comps = index->comps_cap = header->nb_comps;
+    index->nb_comp_buckets = header->nb_comp_buckets;
+    index->nb_node_buckets = header->nb_node_buckets;
+    index->strings_len = index->strings_cap = header->strings_len;
+    bool fits = true;
+#define MAP_COLUMN(field, n) \
+    fits = fits && column_fits(header->field, (n), sizeof(*index->field), header->total_size); \
+    index->field = (void *) ((char *) index->map + header->field);
+    SHARED_COLUMNS(MAP_COLUMN)
+#undef MAP_COLUMN
+    return fits ? 0 : -6;
+}
+
+/**
+ * Attaches read-only to an index copied into a shared memory region by tar_index_export().
+ *
+ * @param tar_fd A file descriptor pointing to the tar archive of the index. It must stay open until tar_index_close().
+ * @param shm_fd A file descriptor of the region, it can be closed once this function returns.
+ * @param index An out argument, set to the attached index on success.
+ *
+ * @return a zero or positive value on success, representing the number of entries in the index,
+ *         -4 if there was a problem in a fonction
+ *         -6 if the region does not hold an index of this archive
+ */
+int tar_index_attach(int tar_fd, int shm_fd, tar_index_t **index) {
+    struct stat st;
+    struct stat archive;
+    if (fstat(shm_fd, &st) == -1 || fstat(tar_fd, &archive) == -1) {
+        return -4;
+    }
+    if ((uint64_t) st.st_size < sizeof(shared_header_t)) {
+        return -6;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, shm_fd, 0);
+    if (map == MAP_FAILED) {
+        return -4;
+    }
+    tar_index_t *idx = calloc(1, sizeof(tar_index_t));
+    if (idx == NULL) {
+        munmap(map, st.st_size);
+        return -4;
+    }
+    idx->map = map;
+    idx->map_len = st.st_size;
+    idx->tar_fd = tar_fd;
+    idx->io_fd = tar_fd;
+
+    const shared_header_t *header = map;
+    shared_header_t expected;
+    archive_identity(&archive, &expected);
+    if (memcmp(header->magic, SHARED_MAGIC, sizeof(header->magic)) != 0 || header->total_size > (uint64_t) st.st_size
+        || header->archive_dev != expected.archive_dev || header->archive_ino != expected.archive_ino
+        || header->archive_size != expected.archive_size || header->archive_mtime != expected.archive_mtime
+        || map_columns(idx, header) != 0) {
+        tar_index_close(idx);
+        return -6;
+    }
+    open_direct(idx);
+    *index = idx;
+    return idx->count;
+}
+
+static void fill_stat(const tar_index_t *index, uint32_t row, struct tar_stat *out) {
+    uint32_t node = index->node[row];
+    out->basename = node == NONE ? index->strings : index->strings + index->comp_name[index->node_comp[node]];
+    out->entry = row;
+    out->linkname = index->strings + index->linkname[row];
+    out->offset = index->offset[row];
+    out->size = index->size[row];
+    out->mtime = index->mtime[row];
+    out->mode = index->mode[row];
+    out->uid = index->uid[row];
+    out->gid = index->gid[row];
+    out->typeflag = index->typeflag[row];
+}
+
+/**
+ * Gets the metadata of an entry of the archive.
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to an entry in the archive.
+ * @param out A destination for the metadata of the entry.
+ *
+ * @return zero if the entry was found,
+ *         -1 if no entry at the given path exists in the archive.
+ */
+int tar_stat(tar_index_t *index, const char *path, struct tar_stat *out) {
+    uint32_t row = find_path(index, path, strlen(path));
+    if (row == NONE) {
+        return -1;
+    }
+    fill_stat(index, row, out);
+    return 0;
+}
+
+/**
+ * Rebuilds the full path of an entry.
+ *
+ * @param index An index built by tar_index_open().
+ * @param entry The entry field of a struct tar_stat filled with this index.
+ * @param path A destination for the path, TAR_PATH_MAX+1 bytes long.
+ *
+ * @return the length of the path.
+ */
+size_t tar_path(tar_index_t *index, uint32_t entry, char *path) {
+    uint32_t node = index->node[entry];
+    size_t len = 0;
+    for (uint32_t p = node; p != NONE; p = index->node_parent[p]) {
+        len += strlen(index->strings + index->comp_name[index->node_comp[p]]) + 1;
+    }
+    if (len > 0) {//pas de / avant le premier composant
+        len--;
+    }
+    len += index->slash[entry];
+    path[len] = '\0';
+    size_t end = len;
+    if (index->slash[entry]) {
+        path[--end] = '/';
+    }
+    for (uint32_t p = node; p != NONE; p = index->node_parent[p]) {//on remplit le chemin depuis la fin
+        const char *comp = index->strings + index->comp_name[index->node_comp[p]];
+        size_t n = strlen(comp);
+        end -= n;
+        memcpy(path + end, comp, n);
+        if (end > 0) {
+            path[--end] = '/';
+        }
+    }
+    return len;
+}
+
+/*
+ * Ligne du répertoire désigné par path, en suivant les liens symboliques comme list().
+ * NONE si ce n'est pas un répertoire.
+ */
+static uint32_t find_dir(const tar_index_t *index, const char *path) {
+    uint32_t row = find_path(index, path, strlen(path));
+    for (size_t hops = 0; row != NONE && index->typeflag[row] == SYMTYPE; hops++) {
+        if (hops == index->count) {//boucle de liens
+            return NONE;
+        }
+        const char *target = index->strings + index->linkname[row];
+        row = find_path(index, target, strlen(target));//"dir" et "dir/" ont le même nœud
+    }
+    if (row == NONE || index->typeflag[row] != DIRTYPE) {
+        return NONE;
+    }
+    return row;
+}
+
+/**
+ * Lists the entries at a given path in the archive with their metadata, like list().
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to a directory in the archive. If the entry is a symlink, it is resolved to its linked-to entry.
+ * @param entries An array of struct tar_stat.
+ * @param no_entries An in-out argument.
+ *                   The caller set it to the number of entries in `entries`.
+ *                   The callee set it to the number of entries listed.
+ *
+ * @return zero if no directory at the given path exists in the archive,
+ *         any other value otherwise.
+ */
+int tar_readdir_plus(tar_index_t *index, const char *path, struct tar_stat *entries, size_t *no_entries) {
+    uint32_t dir = find_dir(index, path);
+    if (dir == NONE) {
+        *no_entries = 0;
+        return 0;
+    }
+    size_t i = 0;
+    for (uint32_t c = index->first_child[dir]; c < index->first_child[dir + 1] && i < *no_entries; c++) {
+        fill_stat(index, index->children[c], &entries[i]);
+        i++;
+    }
+    *no_entries = i;
+    return 1;
+}
+
+/**
+ * Gets the digests of an entry computed when the index was built.
+ *
+ * @param index An index built by tar_index_open() with TAR_HASH_* flags.
+ * @param path A path to an entry in the archive.
+ * @param out A destination for the digests.
+ *
+ * @return zero if the entry was found,
+ *         -1 if no entry at the given path exists in the archive,
+ *         -2 if the index was built without digests.
+ */
+int tar_digest(tar_index_t *index, const char *path, struct tar_digest *out) {
+    if (!(index->flags & HASH_FLAGS)) {
+        return -2;
+    }
+    uint32_t row = find_path(index, path, strlen(path));
+    if (row == NONE) {
+        return -1;
+    }
+    *out = index->digest[row];
+    return 0;
+}
+
+/**
+ * Reads again the content of an entry and checks it against the digests of the index.
+ *
+ * @param index An index built by tar_index_open() with TAR_HASH_* flags.
+ * @param path A path to an entry in the archive.
+ *
+ * @return zero if the content matches the digests,
+ *         1 if the content does not match, or is cut short by the end of the archive,
+ *         -1 if no entry at the given path exists in the archive,
+ *         -2 if the index was built without digests,
+ *         -4 if there was a problem in a fonction
+ */
+int tar_verify(tar_index_t *index, const char *path) {
+    if (!(index->flags & HASH_FLAGS)) {
+        return -2;
+    }
+    uint32_t row = find_path(index, path, strlen(path));
+    if (row == NONE) {
+        return -1;
+    }
+    scanner_t s;
+    if (scan_open(&s, index->io_fd, index->flags, index->offset[row]) != 0) {
+        return -4;
+    }
+    tar_hash_t hash;
+    tar_hash_init(&hash, index->flags);
+    int ret = scan_hash(&s, index->size[row], &hash);
+    bool direct_refused = ret == -4 && (index->flags & TAR_IO_DIRECT) && errno == EINVAL;
+    scan_close(&s);
+    if (direct_refused) {//même repli que dans tar_index_open(), gardé pour les appels suivants (index attaché)
+        close(index->io_fd);
+        index->io_fd = index->tar_fd;
+        index->flags = (index->flags & ~TAR_IO_DIRECT) | TAR_IO_DONTNEED;
+        return tar_verify(index, path);
+    }
+    if (ret == -5) {//l'archive a été tronquée depuis la construction de l'index
+        return 1;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    struct tar_digest digest;
+    tar_hash_final(&hash, &digest);
+    return memcmp(&digest, &index->digest[row], sizeof(struct tar_digest)) == 0 ? 0 : 1;
+}
+
+/**
+ * Starts listing the entries at a given path in the archive.
+ *
+ * @param index An index built by tar_index_open().
+ * @param path A path to a directory in the archive. If the entry is a symlink, it is resolved to its linked-to entry.
+ * @param cursor An out argument, the cursor to give to tar_list_next(). On failure, it lists no entries.
+ *
+ * @return -1 if no directory at the given path exists in the archive,
+ *         the total number of entries in the directory otherwise.
+ */
+ssize_t tar_list_begin(tar_index_t *index, const char *path, tar_cursor_t *cursor) {
+    uint32_t dir = find_dir(index, path);
+    cursor->index = index;
+    if (dir == NONE) {//curseur vide : tar_list_next() retourne zéro
+        cursor->next = 0;
+        cursor->end = 0;
+        return -1;
+    }
+    cursor->next = index->first_child[dir];
+    cursor->end = index->first_child[dir + 1];
+    return cursor->end - cursor->next;
+}
+
+/**
+ * Lists the next entries of a directory.
+ *
+ * @param cursor A cursor initialised by tar_list_begin().
+ * @param batch An array of max char arrays, each one is long enough to contain a tar entry path (TAR_PATH_MAX+1 bytes).
+ * @param max The size of batch.
+ *
+ * @return the number of entries written to batch, zero when all the entries have been listed.
+ */
+size_t tar_list_next(tar_cursor_t *cursor, char **batch, size_t max) {
+    tar_index_t *index = cursor->index;
+    size_t i = 0;
+    while (i < max && cursor->next < cursor->end) {
+        tar_path(index, index->children[cursor->next], batch[i]);
+        cursor->next++;
+        i++;
+    }
+    return i;
+}
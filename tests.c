@@ -1,4 +1,6 @@
+#define _GNU_SOURCE /* memfd_create */
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -24,9 +26,189 @@ void debug_dump(const uint8_t *bytes, size_t len) {
     }
 }
 
+/* Prints the entries listed by list() at path, one per line. */
+static int cmd_ls(int fd, char *path) {
+    size_t no_entries = 1024;
+    char **entries = malloc(no_entries * sizeof(char *));
+    for (size_t i = 0; i < no_entries; i++) {
+        entries[i] = malloc(TAR_PATH_MAX + 1);
+    }
+    int ret = list(fd, path, entries, &no_entries);
+    for (size_t i = 0; ret > 0 && i < no_entries; i++) {
+        printf("%s\n", entries[i]);
+    }
+    for (size_t i = 0; i < 1024; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    return ret > 0 ? 0 : 1;
+}
+
+/*
+ * Builds the index of the archive. With TESTS_SHARED_INDEX set in the environment, the index is exported to a memfd
+ * and the commands use a copy attached to it, like another worker process would.
+ * With TESTS_IO set to direct or dontneed, the index reads the archive with that TAR_IO_* flag and computes
+ * TAR_HASH_CRC32C digests, so that cmd_stat can check tar_verify().
+ */
+static int open_index(int fd, int flags, tar_index_t **index) {
+    const char *io = getenv("TESTS_IO");
+    if (io != NULL && strcmp(io, "direct") == 0) {
+        flags |= TAR_IO_DIRECT | TAR_HASH_CRC32C;
+    } else if (io != NULL && strcmp(io, "dontneed") == 0) {
+        flags |= TAR_IO_DONTNEED | TAR_HASH_CRC32C;
+    }
+    int ret = tar_index_open(fd, flags, index);
+    if (ret < 0 || getenv("TESTS_SHARED_INDEX") == NULL) {
+        return ret;
+    }
+    int shm_fd = memfd_create("tar_index", MFD_ALLOW_SEALING);
+    ret = shm_fd == -1 ? -4 : tar_index_export(*index, shm_fd);
+    tar_index_close(*index);
+    if (ret == 0) {
+        ret = tar_index_attach(fd, shm_fd, index);
+    }
+    if (shm_fd != -1) {
+        close(shm_fd);
+    }
+    return ret;
+}
+
+/* Prints the entries listed by the index cursor at path, one per line. */
+static int cmd_lsi(int fd, char *path) {
+    tar_index_t *index;
+    if (open_index(fd, 0, &index) < 0) {
+        return 1;
+    }
+    tar_cursor_t cursor;
+    ssize_t total = tar_list_begin(index, path, &cursor);
+    static char paths[7][TAR_PATH_MAX + 1];
+    char *batch[7];//petits lots pour passer plusieurs fois dans tar_list_next
+    for (size_t i = 0; i < 7; i++) {
+        batch[i] = paths[i];
+    }
+    size_t listed = 0;
+    for (size_t n; total >= 0 && (n = tar_list_next(&cursor, batch, 7)) > 0; listed += n) {
+        for (size_t i = 0; i < n; i++) {
+            printf("%s\n", batch[i]);
+        }
+    }
+    tar_index_close(index);
+    return total >= 0 && listed == (size_t) total ? 0 : 1;
+}
+
+/* Prints what each function of the library says about path. */
+static int cmd_stat(int fd, char *path) {
+    printf("exists %d is_dir %d is_file %d is_symlink %d\n",
+           exists(fd, path) > 0, is_dir(fd, path) > 0, is_file(fd, path) > 0, is_symlink(fd, path) > 0);
+    tar_index_t *index;
+    if (open_index(fd, 0, &index) < 0) {
+        return 1;
+    }
+    struct tar_stat st;
+    if (tar_stat(index, path, &st) == 0) {
+        printf("type %c size %llu mode %o uid %u gid %u mtime %lld link %s\n", st.typeflag,
+               (unsigned long long) st.size, st.mode, st.uid, st.gid, (long long) st.mtime, st.linkname);
+        char full_path[TAR_PATH_MAX + 1];
+        tar_path(index, st.entry, full_path);
+        printf("path %s basename %s\n", full_path, st.basename);
+        printf("verify %d\n", tar_verify(index, path));
+    }
+    tar_index_close(index);
+    return 0;
+}
+
+/* Prints the digests of the file at path, and what tar_verify() says about it. */
+static int cmd_digest(int fd, char *path) {
+    tar_index_t *index;
+    if (open_index(fd, TAR_HASH_CRC32C | TAR_HASH_XXH64 | TAR_HASH_SHA256, &index) < 0) {
+        return 1;
+    }
+    struct tar_digest digest;
+    int ret = tar_digest(index, path, &digest);
+    if (ret == 0) {
+        printf("crc32c %08x xxh64 %016llx sha256 ", digest.crc32c, (unsigned long long) digest.xxh64);
+        for (size_t i = 0; i < sizeof(digest.sha256); i++) {
+            printf("%02x", digest.sha256[i]);
+        }
+        printf("\nverify %d\n", tar_verify(index, path));
+    }
+    tar_index_close(index);
+    return ret == 0 ? 0 : 1;
+}
+
+/*
+ * Damages the content of the file at path after the index was built, and prints what tar_verify() says:
+ * with one byte flipped, with the byte restored, with the archive truncated in the middle of the content and
+ * truncated inside the header of the file. Also prints what tar_index_open() says about the archive cut at the
+ * end of the content (inside the padding) and about the archive truncated inside the header. The archive is
+ * modified, give it a copy.
+ */
+static int cmd_tamper(char *tar_file, char *path) {
+    int fd = open(tar_file, O_RDWR);
+    tar_index_t *index;
+    if (fd == -1 || open_index(fd, TAR_HASH_CRC32C | TAR_HASH_XXH64 | TAR_HASH_SHA256, &index) < 0) {
+        return 1;
+    }
+    struct tar_stat st;
+    uint8_t byte;
+    if (tar_stat(index, path, &st) != 0 || st.size == 0 || pread(fd, &byte, 1, st.offset + st.size / 2) != 1) {
+        tar_index_close(index);
+        close(fd);
+        return 1;
+    }
+    uint8_t flipped = byte ^ 1;
+    pwrite(fd, &flipped, 1, st.offset + st.size / 2);
+    int ret_flipped = tar_verify(index, path);
+    pwrite(fd, &byte, 1, st.offset + st.size / 2);
+    int ret_restored = tar_verify(index, path);
+    tar_index_t *reopened;
+    ftruncate(fd, st.offset + st.size);
+    int ret_padding = open_index(fd, 0, &reopened);
+    if (ret_padding >= 0) {
+        tar_index_close(reopened);
+    }
+    ftruncate(fd, st.offset + st.size / 2);
+    int ret_truncated = tar_verify(index, path);
+    ftruncate(fd, st.offset - 100);//avant le contenu : en TAR_IO_DIRECT, la fin tombe entre la base alignée et le curseur
+    int ret_before = tar_verify(index, path);
+    tar_index_close(index);
+    int ret_reopen = open_index(fd, 0, &reopened);
+    if (ret_reopen >= 0) {
+        tar_index_close(reopened);
+    }
+    printf("flipped %d restored %d padding %d truncated %d before %d reopen %d\n",
+           ret_flipped, ret_restored, ret_padding, ret_truncated, ret_before, ret_reopen);
+    close(fd);
+    return 0;
+}
+
+/* Writes the content of the file at path to stdout, with read_file() called on small chunks. */
+static int cmd_cat(int fd, char *path) {
+    uint8_t buf[1000];
+    size_t offset = 0;
+    ssize_t ret;
+    do {
+        size_t len = sizeof(buf);
+        ret = read_file(fd, path, offset, buf, &len);
+        if (ret == -2 && offset > 0) {//le fichier fait exactement un multiple de buf
+            return 0;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "read_file returned %zd\n", ret);
+            return 1;
+        }
+        if (len == 0 && ret > 0) {//il resterait des octets mais plus rien ne vient : archive tronquée
+            return 1;
+        }
+        fwrite(buf, 1, len, stdout);
+        offset += len;
+    } while (ret > 0);
+    return 0;
+}
+
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: %s tar_file\n", argv[0]);
+    if (argc < 2 || (argc > 2 && argc != 4)) {
+        printf("Usage: %s tar_file [ls|lsi|stat|cat|digest|tamper path]\n", argv[0]);
         return -1;
     }
 
@@ -36,8 +218,27 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    if (argc == 4) {//commandes utilisées par difftest.sh
+        int ret = -1;
+        if (strcmp(argv[2], "ls") == 0) {
+            ret = cmd_ls(fd, argv[3]);
+        } else if (strcmp(argv[2], "lsi") == 0) {
+            ret = cmd_lsi(fd, argv[3]);
+        } else if (strcmp(argv[2], "stat") == 0) {
+            ret = cmd_stat(fd, argv[3]);
+        } else if (strcmp(argv[2], "cat") == 0) {
+            ret = cmd_cat(fd, argv[3]);
+        } else if (strcmp(argv[2], "digest") == 0) {
+            ret = cmd_digest(fd, argv[3]);
+        } else if (strcmp(argv[2], "tamper") == 0) {
+            ret = cmd_tamper(argv[1], argv[3]);
+        }
+        close(fd);
+        return ret;
+    }
+
     int ret = check_archive(fd);
     printf("check_archive returned %d\n", ret);
 
     return 0;
-}
\ No newline at end of file
+}